@@ -0,0 +1,350 @@
+#include "Benchmark.h"
+#include "ParallelJpegDecoder.h"
+#include "ComposeKernels.h"
+#include "TextRenderer.h"
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <cstdlib>
+#include <ctime>
+#include "X11Presenter.h"
+
+namespace {
+    // Median wall time of a few runs in milliseconds
+    template<typename Func>
+    double timeMs(Func func, int runs = 5)
+    {
+        std::vector<double> times;
+        for (int i = 0; i < runs; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            func();
+            times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::sort(times.begin(), times.end());
+        return times[times.size() / 2];
+    }
+
+    // Smooth gradients plus sensor-like noise compress roughly like a real photo
+    cv::Mat syntheticPhoto(const cv::Size& size)
+    {
+        cv::Mat small(std::max(1, size.height / 64), std::max(1, size.width / 64), CV_8UC3);
+        cv::randu(small, cv::Scalar::all(0), cv::Scalar::all(255));
+        cv::Mat photo;
+        cv::resize(small, photo, size, 0, 0, cv::INTER_CUBIC);
+        cv::Mat noise(size, CV_8UC3);
+        cv::randu(noise, cv::Scalar::all(0), cv::Scalar::all(16));
+        cv::addWeighted(photo, 1.0, noise, 1.0, -8.0, photo);
+        return photo;
+    }
+
+    std::vector<unsigned char> encodeWithRestartMarkers(const cv::Mat& img)
+    {
+        // One restart interval per MCU row of a 4:2:0 JPEG, like many cameras and scanners write
+        std::vector<int> params = { cv::IMWRITE_JPEG_QUALITY, 92, cv::IMWRITE_JPEG_RST_INTERVAL, (img.cols + 15) / 16 };
+        std::vector<unsigned char> data;
+        cv::imencode(".jpg", img, data, params);
+        return data;
+    }
+
+    void reportDecode(const std::string& name, const std::vector<unsigned char>& data, double& recommended)
+    {
+        ParallelJpegDecoder decoder(data);
+        cv::Size size = decoder.getImageSize();
+        double megapixels = size.area() / 1e6;
+
+        if (!decoder.canSplit()) {
+            std::cout << std::setw(24) << name << std::setw(8) << megapixels << "  no usable restart markers" << std::endl;
+            return;
+        }
+
+        int threads = cv::getNumberOfCPUs();
+        const int scales[] = { cv::IMREAD_COLOR, cv::IMREAD_REDUCED_COLOR_2 };
+        for (int flags : scales) {
+            double serial = timeMs([&]() { cv::imdecode(data, flags | cv::IMREAD_IGNORE_ORIENTATION); });
+            double parallel = timeMs([&]() { ParallelJpegDecoder(data).decode(flags, threads); });
+            double speedup = serial / parallel;
+
+            std::cout << std::setw(24) << name << std::setw(8) << megapixels
+                      << std::setw(8) << (flags == cv::IMREAD_COLOR ? "1/1" : "1/2")
+                      << std::setw(12) << serial << std::setw(12) << parallel
+                      << std::setw(10) << speedup << std::endl;
+
+            // Threshold: smallest image where the split pays off clearly at screen scale
+            if (flags != cv::IMREAD_COLOR && speedup >= 1.5 && (recommended == 0 || megapixels < recommended)) {
+                recommended = megapixels;
+            }
+        }
+    }
+
+    void benchmarkParallelDecode(const std::vector<std::string>& files)
+    {
+        std::cout << "\n== Parallel JPEG decode (" << cv::getNumberOfCPUs() << " cores) ==" << std::endl;
+        std::cout << std::fixed << std::setprecision(1);
+        std::cout << std::setw(24) << "image" << std::setw(8) << "MP" << std::setw(8) << "scale"
+                  << std::setw(12) << "serial ms" << std::setw(12) << "bands ms" << std::setw(10) << "speedup" << std::endl;
+
+        double recommended = 0;
+        const cv::Size sizes[] = { {3000, 2000}, {4000, 3000}, {4896, 3264}, {6000, 4000}, {8000, 6000}, {12000, 8000} };
+        for (const cv::Size& size : sizes) {
+            std::vector<unsigned char> data = encodeWithRestartMarkers(syntheticPhoto(size));
+            reportDecode(std::to_string(size.width) + "x" + std::to_string(size.height), data, recommended);
+        }
+
+        for (const std::string& path : files) {
+            std::ifstream file(path, std::ios::binary);
+            std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            reportDecode(path.substr(path.find_last_of('/') + 1), data, recommended);
+        }
+
+        if (recommended > 0) {
+            std::cout << "Recommended \"parallelDecodeMinMegapixels\": " << recommended << std::endl;
+        } else {
+            std::cout << "Parallel decode did not pay off on this machine, keep the threshold high" << std::endl;
+        }
+    }
+
+    // The letterbox path before the fused kernel: resize, zero a new frame, copy in
+    cv::Mat legacyCompose(const cv::Mat& img, const cv::Size& screen, int interpolation)
+    {
+        double imgAspect = static_cast<double>(img.cols) / img.rows;
+        double screenAspect = static_cast<double>(screen.width) / screen.height;
+        cv::Size fit = imgAspect > screenAspect ? cv::Size(screen.width, static_cast<int>(screen.width / imgAspect))
+                                                : cv::Size(static_cast<int>(screen.height * imgAspect), screen.height);
+        cv::Mat resized;
+        cv::resize(img, resized, fit, 0, 0, interpolation);
+        cv::Mat frame = cv::Mat::zeros(screen, resized.type());
+        resized.copyTo(frame(cv::Rect((screen.width - fit.width) / 2, (screen.height - fit.height) / 2, fit.width, fit.height)));
+        return frame;
+    }
+
+    void benchmarkCompose()
+    {
+        const cv::Size screen(1920, 1200);
+        std::cout << "\n== Resize + letterbox to " << screen.width << "x" << screen.height << " ==" << std::endl;
+        std::cout << std::setw(24) << "decoded image" << std::setw(14) << "linear ms" << std::setw(12) << "area ms"
+                  << std::setw(12) << "fused ms" << std::setw(10) << "speedup" << std::setw(12) << "diff area" << std::endl;
+
+        // Sizes as they leave the decoder: camera JPEGs at 1/2 DCT scale, phone
+        // photos at full size, portrait shots and a full-size PNG/TIFF
+        const cv::Size sizes[] = { {2000, 1500}, {3000, 2000}, {4032, 3024}, {1500, 2000}, {6000, 4000} };
+        cv::Mat frame(screen, CV_8UC3);
+        for (const cv::Size& size : sizes) {
+            cv::Mat img = syntheticPhoto(size);
+            double linear = timeMs([&]() { legacyCompose(img, screen, cv::INTER_LINEAR); });
+            double area = timeMs([&]() { legacyCompose(img, screen, cv::INTER_AREA); });
+            double fused = timeMs([&]() { ComposeKernels::letterbox(img, frame); });
+
+            // The fused kernel should match OpenCV's area resampling up to rounding
+            double difference = cv::norm(frame, legacyCompose(img, screen, cv::INTER_AREA), cv::NORM_L1) / frame.total() / 3;
+
+            std::cout << std::setw(24) << (std::to_string(size.width) + "x" + std::to_string(size.height))
+                      << std::setw(14) << linear << std::setw(12) << area << std::setw(12) << fused
+                      << std::setw(10) << linear / fused << std::setw(12) << std::setprecision(2) << difference
+                      << std::setprecision(1) << std::endl;
+        }
+
+        // Portrait panel: the upright 1200x1920 layout goes into the 1920x1200 scanout frame
+        cv::Mat img = syntheticPhoto(cv::Size(4032, 3024)), upright(1920, 1200, CV_8UC3), rotated;
+        double twoPass = timeMs([&]() {
+            ComposeKernels::letterbox(img, upright);
+            cv::rotate(upright, rotated, cv::ROTATE_90_CLOCKWISE);
+        });
+        double onePass = timeMs([&]() { ComposeKernels::letterbox(img, frame, 90); });
+        std::cout << "Portrait panel, 4032x3024: letterbox + cv::rotate " << twoPass << " ms, rotated letterbox "
+                  << onePass << " ms" << std::endl;
+    }
+
+    // Date overlay as it was drawn before the mask cache and the glyph atlas
+    void legacyOverlay(cv::Mat& frame, const cv::Rect& box, const std::string& date, const std::string& folder)
+    {
+        cv::Mat roi = frame(box);
+        cv::Mat original;
+        roi.copyTo(original);
+
+        cv::Mat overlay;
+        roi.copyTo(overlay);
+        overlay.setTo(cv::Scalar(0, 0, 0));
+        int radius = 10;
+        cv::Mat mask = cv::Mat::zeros(box.height, box.width, CV_8UC1);
+        cv::rectangle(mask, cv::Rect(radius, 0, mask.cols - 2 * radius, mask.rows), 255, cv::FILLED);
+        cv::rectangle(mask, cv::Rect(0, radius, mask.cols, mask.rows - 2 * radius), 255, cv::FILLED);
+        cv::circle(mask, cv::Point(radius, radius), radius, 255, cv::FILLED);
+        cv::circle(mask, cv::Point(mask.cols - radius, radius), radius, 255, cv::FILLED);
+        cv::circle(mask, cv::Point(radius, mask.rows - radius), radius, 255, cv::FILLED);
+        cv::circle(mask, cv::Point(mask.cols - radius, mask.rows - radius), radius, 255, cv::FILLED);
+        overlay.copyTo(roi, mask);
+        cv::addWeighted(overlay, 0.5, roi, 0.5, 0, roi);
+        cv::addWeighted(original, 0.5, roi, 0.5, 0, roi);
+
+        int baseline = 0;
+        cv::Size size = cv::getTextSize(date, cv::FONT_HERSHEY_SIMPLEX, 0.8, 1, &baseline);
+        cv::putText(frame, date, cv::Point(box.x + 5, box.y + 5 + size.height), cv::FONT_HERSHEY_SIMPLEX, 0.8, cv::Scalar(255, 255, 255), 1, cv::LINE_AA);
+        cv::putText(frame, folder, cv::Point(box.x + 5, box.y + 10 + 2 * size.height), cv::FONT_HERSHEY_SIMPLEX, 0.8, cv::Scalar(255, 255, 255), 1, cv::LINE_AA);
+    }
+
+    void benchmarkOverlay()
+    {
+        std::cout << "\n== Date overlay on a 1920x1200 frame ==" << std::endl;
+        const std::string date = "Sunday, 14 June 2020";
+        const std::string folder = "Weltreise 2020 - Aegypten";
+        const int runs = 200;
+        cv::Mat frame = syntheticPhoto(cv::Size(1920, 1200));
+        cv::Rect box(25, 25, 360, 70);
+
+        double legacy = timeMs([&]() {
+            for (int i = 0; i < runs; ++i) legacyOverlay(frame, box, date, folder);
+        }) * 1000 / runs;
+
+        // Masks and text blocks are cached after the first frame, as on the frame
+        TextRenderer text("/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf");
+        text.preload(26);
+        cv::Mat mask = ComposeKernels::roundedRectMask(box.size(), 10);
+        double boxOnly = timeMs([&]() {
+            for (int i = 0; i < runs; ++i) ComposeKernels::blendMask(frame, mask, box.tl(), cv::Scalar(0, 0, 0), 0.5);
+        }) * 1000 / runs;
+        double fused = timeMs([&]() {
+            for (int i = 0; i < runs; ++i) {
+                ComposeKernels::blendMask(frame, mask, box.tl(), cv::Scalar(0, 0, 0), 0.5);
+                text.draw(frame, date, 26, cv::Point(box.x + 5, box.y + 5), cv::Scalar(255, 255, 255));
+                text.draw(frame, folder, 26, cv::Point(box.x + 5, box.y + 35), cv::Scalar(255, 255, 255));
+            }
+        }) * 1000 / runs;
+
+        std::cout << "Hershey text + masked addWeighted: " << legacy << " us" << std::endl;
+        std::cout << "Cached rounded box only:          " << boxOnly << " us" << std::endl;
+        std::cout << "Cached box + atlas text:          " << fused << " us  (" << legacy / fused << "x)" << std::endl;
+    }
+
+    void benchmarkCrossfade()
+    {
+        std::cout << "\n== Crossfade step at 1920x1200, one core ==" << std::endl;
+        cv::Size screen(1920, 1200);
+        cv::Mat from = syntheticPhoto(screen), to = syntheticPhoto(screen), blended;
+
+        // The kernel is single threaded, keep OpenCV's addWeighted on one core as well
+        int threads = cv::getNumThreads();
+        cv::setNumThreads(1);
+        std::vector<double> steps;
+        for (int weight = 0; weight < 256; weight += 8) {
+            auto start = std::chrono::steady_clock::now();
+            ComposeKernels::crossfade(from, to, weight, blended);
+            steps.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        double addWeighted = timeMs([&]() { cv::addWeighted(from, 0.5, to, 0.5, 0, blended); });
+        cv::setNumThreads(threads);
+
+        std::sort(steps.begin(), steps.end());
+        double average = 0;
+        for (double step : steps) average += step;
+        average /= steps.size();
+        std::cout << "SIMD blend: " << average << " ms avg, " << steps.back() << " ms max, "
+                  << 1000.0 / steps.back() << " fps worst case" << std::endl;
+        std::cout << "cv::addWeighted: " << addWeighted << " ms" << std::endl;
+    }
+
+    void benchmarkKenBurns()
+    {
+        std::cout << "\n== Ken Burns frame at 1920x1200 from a 1.3x source, all cores ==" << std::endl;
+        cv::Size screen(1920, 1200);
+        cv::Mat source = syntheticPhoto(cv::Size(2496, 1560)), frame(screen, CV_8UC3), reference;
+
+        // The zoom and pan of a full slide, in 1/25 s frames of a 25 s slide
+        auto poseAt = [&](int i) {
+            double t = i / 625.0, scale = (1.0 + 0.3 * t) / 1.3;
+            return cv::Matx23d(1.0 / scale, 0.0, 200.0 * t, 0.0, 1.0 / scale, 100.0 * t);
+        };
+        std::vector<double> frames;
+        for (int i = 0; i < 625; i += 25) {
+            cv::Matx23d pose = poseAt(i);
+            auto start = std::chrono::steady_clock::now();
+            ComposeKernels::warpAffine(source, pose, frame);
+            frames.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        double warpAffine = timeMs([&]() {
+            cv::warpAffine(source, reference, cv::Mat(poseAt(300)), screen, cv::INTER_LINEAR | cv::WARP_INVERSE_MAP);
+        });
+
+        std::sort(frames.begin(), frames.end());
+        double average = 0;
+        for (double time : frames) average += time;
+        average /= frames.size();
+        std::cout << "Fixed-point warp: " << average << " ms avg, " << frames.back() << " ms max, "
+                  << 1000.0 / frames.back() << " fps worst case" << std::endl;
+        std::cout << "cv::warpAffine: " << warpAffine << " ms" << std::endl;
+    }
+
+    double processCpuMs()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+    }
+
+    // Wall and CPU time per shown frame, presenting and pumping window events
+    template<typename Present>
+    void reportPresent(const std::string& name, const cv::Mat* frames, Present present)
+    {
+        const int runs = 60;
+        double cpuStart = processCpuMs();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < runs; ++i) {
+            present(frames[i % 2]);
+        }
+        double wall = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << std::setw(24) << name << std::setw(12) << wall / runs << std::setw(12) << (processCpuMs() - cpuStart) / runs << std::endl;
+    }
+
+    void benchmarkPresent()
+    {
+        std::cout << "\n== Present a screen frame ==" << std::endl;
+        if (!std::getenv("DISPLAY")) {
+            std::cout << "No X display, skipped" << std::endl;
+            return;
+        }
+
+        cv::Size screen;
+        {
+            X11Presenter presenter;
+            if (!presenter.open("Benchmark")) {
+                std::cout << "MIT-SHM not available, nothing to compare" << std::endl;
+                return;
+            }
+            screen = presenter.getScreenSize();
+            cv::Mat frames[2] = { syntheticPhoto(screen), syntheticPhoto(screen) };
+            presenter.waitKey(200);
+            presenter.logStats();
+
+            std::cout << std::setw(24) << "path" << std::setw(12) << "wall ms" << std::setw(12) << "CPU ms" << std::endl;
+            reportPresent("XShmPutImage", frames, [&](const cv::Mat& frame) {
+                presenter.present(frame);
+                presenter.waitKey(1);
+            });
+            presenter.logStats();
+        }
+
+        cv::Mat frames[2] = { syntheticPhoto(screen), syntheticPhoto(screen) };
+        cv::namedWindow("Benchmark", cv::WINDOW_NORMAL);
+        cv::setWindowProperty("Benchmark", cv::WND_PROP_FULLSCREEN, cv::WINDOW_FULLSCREEN);
+        cv::imshow("Benchmark", frames[0]);
+        cv::waitKey(200);
+        reportPresent("imshow + waitKey", frames, [&](const cv::Mat& frame) {
+            cv::imshow("Benchmark", frame);
+            cv::waitKey(1);
+        });
+        cv::destroyAllWindows();
+    }
+}
+
+int runBenchmarks(const std::vector<std::string>& args)
+{
+    benchmarkParallelDecode(args);
+    benchmarkCompose();
+    benchmarkOverlay();
+    benchmarkCrossfade();
+    benchmarkKenBurns();
+    benchmarkPresent();
+    return 0;
+}
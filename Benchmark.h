@@ -0,0 +1,8 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Micro-benchmarks for the decode and compose paths, started with "main --bench".
+// Optional arguments are JPEG files to include next to the synthetic images.
+int runBenchmarks(const std::vector<std::string>& args);
@@ -0,0 +1,568 @@
+#include "ComposeKernels.h"
+#include "RenderTarget.h"
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+#if CV_SIMD
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 8)
+    inline int lanesU8() { return cv::VTraits<cv::v_uint8>::vlanes(); }
+#else
+    inline int lanesU8() { return cv::v_uint8::nlanes; }
+#endif
+#endif
+
+    // Resampling weights are Q8 fixed point and sum to exactly 256 per output
+    // pixel, so a vertical pass over 8-bit input never overflows 16 bits.
+    const int weightBits = 8;
+    const int weightOne = 1 << weightBits;
+
+    struct ResampleTable {
+        std::vector<int> start;
+        std::vector<int> count;
+        std::vector<int> offset;
+        std::vector<uint16_t> weights;
+    };
+
+    // Area coverage when shrinking, linear interpolation when enlarging
+    ResampleTable buildTable(int srcLength, int dstLength)
+    {
+        ResampleTable table;
+        table.start.resize(dstLength);
+        table.count.resize(dstLength);
+        table.offset.resize(dstLength);
+        double scale = static_cast<double>(srcLength) / dstLength;
+
+        std::vector<double> taps;
+        for (int i = 0; i < dstLength; ++i) {
+            taps.clear();
+            int first;
+            if (scale >= 1.0) {
+                double begin = i * scale;
+                double end = std::min(static_cast<double>(srcLength), (i + 1) * scale);
+                first = static_cast<int>(std::floor(begin));
+                for (int s = first; s < end; ++s) {
+                    taps.push_back((std::min<double>(s + 1, end) - std::max<double>(s, begin)) / scale);
+                }
+            } else {
+                double center = (i + 0.5) * scale - 0.5;
+                first = std::max(0, std::min(srcLength - 1, static_cast<int>(std::floor(center))));
+                double fraction = std::max(0.0, std::min(1.0, center - first));
+                taps.push_back(1.0 - fraction);
+                if (first + 1 < srcLength) {
+                    taps.push_back(fraction);
+                }
+            }
+
+            table.start[i] = first;
+            table.count[i] = static_cast<int>(taps.size());
+            table.offset[i] = static_cast<int>(table.weights.size());
+
+            // Round to Q8 and give the rounding error to the largest tap
+            int sum = 0;
+            size_t largest = 0;
+            for (size_t t = 0; t < taps.size(); ++t) {
+                uint16_t w = static_cast<uint16_t>(std::lround(taps[t] * weightOne));
+                table.weights.push_back(w);
+                sum += w;
+                if (taps[t] > taps[largest]) largest = t;
+            }
+            table.weights[table.offset[i] + largest] = static_cast<uint16_t>(table.weights[table.offset[i] + largest] + weightOne - sum);
+        }
+        return table;
+    }
+
+    // acc[i] = sum of weight_k * row_k[i], 16-bit accumulators
+    void verticalPass(const cv::Mat& src, const ResampleTable& rows, int y, uint16_t* acc, int length)
+    {
+        const uint16_t* weights = &rows.weights[rows.offset[y]];
+        int taps = rows.count[y];
+        int i = 0;
+
+#if CV_SIMD
+        const int lanes = lanesU8();
+        for (; i <= length - lanes; i += lanes) {
+            cv::v_uint16 sumLow = cv::vx_setzero_u16(), sumHigh = cv::vx_setzero_u16();
+            for (int k = 0; k < taps; ++k) {
+                cv::v_uint16 low, high;
+                cv::v_expand(cv::vx_load(src.ptr<uchar>(rows.start[y] + k) + i), low, high);
+                cv::v_uint16 w = cv::vx_setall_u16(weights[k]);
+                sumLow = sumLow + cv::v_mul_wrap(low, w);
+                sumHigh = sumHigh + cv::v_mul_wrap(high, w);
+            }
+            cv::v_store(acc + i, sumLow);
+            cv::v_store(acc + i + lanes / 2, sumHigh);
+        }
+#endif
+
+        for (; i < length; ++i) {
+            unsigned sum = 0;
+            for (int k = 0; k < taps; ++k) {
+                sum += weights[k] * src.ptr<uchar>(rows.start[y] + k)[i];
+            }
+            acc[i] = static_cast<uint16_t>(sum);
+        }
+    }
+
+    // pixelStep is the byte distance between neighbouring output pixels, the
+    // row of a portrait layout goes down a column of the scanout frame
+    void horizontalPass(const uint16_t* acc, const ResampleTable& cols, uchar* out, ptrdiff_t pixelStep, int width)
+    {
+        const unsigned round = 1u << (2 * weightBits - 1);
+        for (int x = 0; x < width; ++x, out += pixelStep) {
+            const uint16_t* weights = &cols.weights[cols.offset[x]];
+            const uint16_t* in = acc + cols.start[x] * 3;
+            unsigned b = round, g = round, r = round;
+            for (int k = 0; k < cols.count[x]; ++k, in += 3) {
+                b += weights[k] * in[0];
+                g += weights[k] * in[1];
+                r += weights[k] * in[2];
+            }
+            out[0] = static_cast<uchar>(b >> (2 * weightBits));
+            out[1] = static_cast<uchar>(g >> (2 * weightBits));
+            out[2] = static_cast<uchar>(r >> (2 * weightBits));
+        }
+    }
+
+    // Warp tiles: 256 output pixels wide so the source rows a tile reads stay
+    // in cache, and enough of them to keep every core busy on a screen frame
+    const int tileWidth = 256;
+    const int tileHeight = 32;
+    const int coordBits = 16;
+
+    inline int64_t toFixed(double value) {
+        // Far outside values only need to stay outside, keep them away from overflow
+        return static_cast<int64_t>(std::llround(std::max(-1e12, std::min(1e12, value)) * (1 << coordBits)));
+    }
+
+    // acc[i] = a[i] * (256 - weight) + b[i] * weight
+    void blendRows(const uchar* a, const uchar* b, int weight, uint16_t* acc, int length)
+    {
+        int i = 0;
+
+#if CV_SIMD
+        const int lanes = lanesU8();
+        const cv::v_uint16 wa = cv::vx_setall_u16(static_cast<uint16_t>(weightOne - weight));
+        const cv::v_uint16 wb = cv::vx_setall_u16(static_cast<uint16_t>(weight));
+        for (; i <= length - lanes; i += lanes) {
+            cv::v_uint16 aLow, aHigh, bLow, bHigh;
+            cv::v_expand(cv::vx_load(a + i), aLow, aHigh);
+            cv::v_expand(cv::vx_load(b + i), bLow, bHigh);
+            cv::v_store(acc + i, cv::v_mul_wrap(aLow, wa) + cv::v_mul_wrap(bLow, wb));
+            cv::v_store(acc + i + lanes / 2, cv::v_mul_wrap(aHigh, wa) + cv::v_mul_wrap(bHigh, wb));
+        }
+#endif
+
+        for (; i < length; ++i) {
+            acc[i] = static_cast<uint16_t>(a[i] * (weightOne - weight) + b[i] * weight);
+        }
+    }
+
+    // Scale and translate only: the source column and weight of every output
+    // column are the same on all rows, and each row reads just two source rows
+    void warpSeparable(const cv::Mat& src, const cv::Matx23d& m, cv::Mat& dst)
+    {
+        const int64_t maxX = static_cast<int64_t>(src.cols - 1) << coordBits;
+        const int64_t maxY = static_cast<int64_t>(src.rows - 1) << coordBits;
+
+        // Byte offset of the left source pixel, -1 outside, its Q8 weight and the step to its neighbour
+        std::vector<int> offsets(dst.cols), weights(dst.cols), next(dst.cols);
+        for (int x = 0; x < dst.cols; ++x) {
+            int64_t sx = toFixed(m(0, 0) * x + m(0, 2));
+            bool inside = sx >= 0 && sx <= maxX;
+            int x0 = inside ? static_cast<int>(sx >> coordBits) : 0;
+            offsets[x] = inside ? x0 * 3 : -1;
+            weights[x] = static_cast<int>((sx >> (coordBits - weightBits)) & (weightOne - 1));
+            next[x] = x0 < src.cols - 1 ? 3 : 0;
+        }
+
+        const int tilesX = (dst.cols + tileWidth - 1) / tileWidth;
+        const int tilesY = (dst.rows + tileHeight - 1) / tileHeight;
+        cv::parallel_for_(cv::Range(0, tilesX * tilesY), [&](const cv::Range& range) {
+            std::vector<uint16_t> acc(static_cast<size_t>(src.cols) * 3);
+            const unsigned round = 1u << (2 * weightBits - 1);
+            for (int tile = range.start; tile < range.end; ++tile) {
+                int x0 = tile % tilesX * tileWidth, x1 = std::min(dst.cols, x0 + tileWidth);
+                int y0 = tile / tilesX * tileHeight, y1 = std::min(dst.rows, y0 + tileHeight);
+
+                // Source bytes the tile reads, the vertical blend covers only those
+                int first = src.cols * 3, last = 0;
+                for (int x = x0; x < x1; ++x) {
+                    if (offsets[x] < 0) continue;
+                    first = std::min(first, offsets[x]);
+                    last = std::max(last, offsets[x] + next[x] + 3);
+                }
+
+                for (int y = y0; y < y1; ++y) {
+                    uchar* out = dst.ptr<uchar>(y);
+                    int64_t sy = toFixed(m(1, 1) * y + m(1, 2));
+                    if (first >= last || sy < 0 || sy > maxY) {
+                        std::memset(out + x0 * 3, 0, static_cast<size_t>(x1 - x0) * 3);
+                        continue;
+                    }
+
+                    int row = static_cast<int>(sy >> coordBits);
+                    int fy = static_cast<int>((sy >> (coordBits - weightBits)) & (weightOne - 1));
+                    const uchar* top = src.ptr<uchar>(row);
+                    const uchar* bottom = src.ptr<uchar>(std::min(row + 1, src.rows - 1));
+                    blendRows(top + first, bottom + first, fy, acc.data(), last - first);
+
+                    for (int x = x0; x < x1; ++x) {
+                        uchar* pixel = out + x * 3;
+                        if (offsets[x] < 0) {
+                            pixel[0] = pixel[1] = pixel[2] = 0;
+                            continue;
+                        }
+                        const uint16_t* in = acc.data() + offsets[x] - first;
+                        unsigned fx = static_cast<unsigned>(weights[x]), inverse = weightOne - fx;
+                        int n = next[x];
+                        pixel[0] = static_cast<uchar>((in[0] * inverse + in[n] * fx + round) >> (2 * weightBits));
+                        pixel[1] = static_cast<uchar>((in[1] * inverse + in[n + 1] * fx + round) >> (2 * weightBits));
+                        pixel[2] = static_cast<uchar>((in[2] * inverse + in[n + 2] * fx + round) >> (2 * weightBits));
+                    }
+                }
+            }
+        });
+    }
+
+    // A quarter turn plus scale and translate, as on portrait panels: an
+    // output row reads one pair of source columns, an output column one pair
+    // of source rows. Each tile copies the source block it reads transposed,
+    // after that it is the separable case with the SIMD row blend.
+    void warpTransposed(const cv::Mat& src, const cv::Matx23d& m, cv::Mat& dst)
+    {
+        const int64_t maxX = static_cast<int64_t>(src.cols - 1) << coordBits;
+        const int64_t maxY = static_cast<int64_t>(src.rows - 1) << coordBits;
+
+        // Source row of every output column, -1 outside, its Q8 weight and whether it has a neighbour
+        std::vector<int> rows(dst.cols), weights(dst.cols), next(dst.cols);
+        for (int x = 0; x < dst.cols; ++x) {
+            int64_t sy = toFixed(m(1, 0) * x + m(1, 2));
+            bool inside = sy >= 0 && sy <= maxY;
+            int y0 = inside ? static_cast<int>(sy >> coordBits) : 0;
+            rows[x] = inside ? y0 : -1;
+            weights[x] = static_cast<int>((sy >> (coordBits - weightBits)) & (weightOne - 1));
+            next[x] = y0 < src.rows - 1 ? 1 : 0;
+        }
+
+        const int tilesX = (dst.cols + tileWidth - 1) / tileWidth;
+        const int tilesY = (dst.rows + tileHeight - 1) / tileHeight;
+        cv::parallel_for_(cv::Range(0, tilesX * tilesY), [&](const cv::Range& range) {
+            std::vector<uchar> block;
+            std::vector<uint16_t> acc;
+            const unsigned round = 1u << (2 * weightBits - 1);
+            for (int tile = range.start; tile < range.end; ++tile) {
+                int x0 = tile % tilesX * tileWidth, x1 = std::min(dst.cols, x0 + tileWidth);
+                int y0 = tile / tilesX * tileHeight, y1 = std::min(dst.rows, y0 + tileHeight);
+
+                // Source rows and columns the tile reads
+                int firstRow = src.rows, lastRow = 0;
+                for (int x = x0; x < x1; ++x) {
+                    if (rows[x] < 0) continue;
+                    firstRow = std::min(firstRow, rows[x]);
+                    lastRow = std::max(lastRow, rows[x] + next[x] + 1);
+                }
+                int firstCol = src.cols, lastCol = 0;
+                for (int y = y0; y < y1; ++y) {
+                    int64_t sx = toFixed(m(0, 1) * y + m(0, 2));
+                    if (sx < 0 || sx > maxX) continue;
+                    int col = static_cast<int>(sx >> coordBits);
+                    firstCol = std::min(firstCol, col);
+                    lastCol = std::max(lastCol, std::min(col + 2, src.cols));
+                }
+                if (firstRow >= lastRow || firstCol >= lastCol) {
+                    for (int y = y0; y < y1; ++y) {
+                        std::memset(dst.ptr<uchar>(y) + x0 * 3, 0, static_cast<size_t>(x1 - x0) * 3);
+                    }
+                    continue;
+                }
+
+                // Block row i is source column firstCol + i, read along the source rows
+                const int blockLength = (lastRow - firstRow) * 3;
+                block.resize(static_cast<size_t>(lastCol - firstCol) * blockLength);
+                acc.resize(blockLength);
+                for (int r = firstRow; r < lastRow; ++r) {
+                    const uchar* in = src.ptr<uchar>(r) + firstCol * 3;
+                    uchar* out = block.data() + (r - firstRow) * 3;
+                    for (int c = firstCol; c < lastCol; ++c, in += 3, out += blockLength) {
+                        out[0] = in[0];
+                        out[1] = in[1];
+                        out[2] = in[2];
+                    }
+                }
+
+                for (int y = y0; y < y1; ++y) {
+                    uchar* out = dst.ptr<uchar>(y);
+                    int64_t sx = toFixed(m(0, 1) * y + m(0, 2));
+                    if (sx < 0 || sx > maxX) {
+                        std::memset(out + x0 * 3, 0, static_cast<size_t>(x1 - x0) * 3);
+                        continue;
+                    }
+
+                    int col = static_cast<int>(sx >> coordBits);
+                    int fx = static_cast<int>((sx >> (coordBits - weightBits)) & (weightOne - 1));
+                    const uchar* left = block.data() + static_cast<size_t>(col - firstCol) * blockLength;
+                    const uchar* right = col + 1 < lastCol ? left + blockLength : left;
+                    blendRows(left, right, fx, acc.data(), blockLength);
+
+                    for (int x = x0; x < x1; ++x) {
+                        uchar* pixel = out + x * 3;
+                        if (rows[x] < 0) {
+                            pixel[0] = pixel[1] = pixel[2] = 0;
+                            continue;
+                        }
+                        const uint16_t* in = acc.data() + (rows[x] - firstRow) * 3;
+                        unsigned fy = static_cast<unsigned>(weights[x]), inverse = weightOne - fy;
+                        int n = next[x] * 3;
+                        pixel[0] = static_cast<uchar>((in[0] * inverse + in[n] * fy + round) >> (2 * weightBits));
+                        pixel[1] = static_cast<uchar>((in[1] * inverse + in[n + 1] * fy + round) >> (2 * weightBits));
+                        pixel[2] = static_cast<uchar>((in[2] * inverse + in[n + 2] * fy + round) >> (2 * weightBits));
+                    }
+                }
+            }
+        });
+    }
+
+    // Any affine map, four source pixels per output pixel
+    void warpGeneral(const cv::Mat& src, const cv::Matx23d& m, cv::Mat& dst)
+    {
+        const uint64_t maxX = static_cast<uint64_t>(src.cols - 1) << coordBits;
+        const uint64_t maxY = static_cast<uint64_t>(src.rows - 1) << coordBits;
+        const int64_t dx = toFixed(m(0, 0)), dy = toFixed(m(1, 0));
+
+        const int tilesX = (dst.cols + tileWidth - 1) / tileWidth;
+        const int tilesY = (dst.rows + tileHeight - 1) / tileHeight;
+        cv::parallel_for_(cv::Range(0, tilesX * tilesY), [&](const cv::Range& range) {
+            const unsigned round = 1u << (2 * weightBits - 1);
+            for (int tile = range.start; tile < range.end; ++tile) {
+                int x0 = tile % tilesX * tileWidth, x1 = std::min(dst.cols, x0 + tileWidth);
+                int y0 = tile / tilesX * tileHeight, y1 = std::min(dst.rows, y0 + tileHeight);
+
+                for (int y = y0; y < y1; ++y) {
+                    uchar* pixel = dst.ptr<uchar>(y) + x0 * 3;
+                    int64_t sx = toFixed(m(0, 0) * x0 + m(0, 1) * y + m(0, 2));
+                    int64_t sy = toFixed(m(1, 0) * x0 + m(1, 1) * y + m(1, 2));
+                    for (int x = x0; x < x1; ++x, sx += dx, sy += dy, pixel += 3) {
+                        // Negative coordinates wrap to huge unsigned values
+                        if (static_cast<uint64_t>(sx) > maxX || static_cast<uint64_t>(sy) > maxY) {
+                            pixel[0] = pixel[1] = pixel[2] = 0;
+                            continue;
+                        }
+                        int col = static_cast<int>(sx >> coordBits), row = static_cast<int>(sy >> coordBits);
+                        unsigned fx = static_cast<unsigned>((sx >> (coordBits - weightBits)) & (weightOne - 1));
+                        unsigned fy = static_cast<unsigned>((sy >> (coordBits - weightBits)) & (weightOne - 1));
+                        const uchar* top = src.ptr<uchar>(row) + col * 3;
+                        const uchar* bottom = src.ptr<uchar>(std::min(row + 1, src.rows - 1)) + col * 3;
+                        int n = col < src.cols - 1 ? 3 : 0;
+                        for (int c = 0; c < 3; ++c) {
+                            unsigned upper = top[c] * (weightOne - fx) + top[c + n] * fx;
+                            unsigned lower = bottom[c] * (weightOne - fx) + bottom[c + n] * fx;
+                            pixel[c] = static_cast<uchar>((upper * (weightOne - fy) + lower * fy + round) >> (2 * weightBits));
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    // Exact rounded x / 255 for x <= 255 * 255
+    inline unsigned div255(unsigned x) {
+        x += 128;
+        return (x + (x >> 8)) >> 8;
+    }
+}
+
+namespace ComposeKernels {
+
+cv::Rect letterbox(const cv::Mat& src, cv::Mat& dst, int rotation)
+{
+    CV_Assert(src.type() == CV_8UC3 && dst.type() == CV_8UC3 && !src.empty());
+
+    RenderTarget target;
+    target.size = dst.size();
+    target.rotation = RenderTarget::normalizeRotation(rotation);
+    cv::Size upright = target.logicalSize();
+
+    double srcAspect = static_cast<double>(src.cols) / src.rows;
+    double dstAspect = static_cast<double>(upright.width) / upright.height;
+    int width = srcAspect > dstAspect ? upright.width : std::max(1, static_cast<int>(upright.height * srcAspect));
+    int height = srcAspect > dstAspect ? std::max(1, static_cast<int>(upright.width / srcAspect)) : upright.height;
+    cv::Rect content((upright.width - width) / 2, (upright.height - height) / 2, width, height);
+    cv::Rect physical = target.toPhysical(content);
+
+    ResampleTable rows = buildTable(src.rows, height);
+    ResampleTable cols = buildTable(src.cols, width);
+
+    // Step from one upright pixel to the next in the scanout frame
+    cv::Point next = target.toPhysical(cv::Point(1, 0)) - target.toPhysical(cv::Point(0, 0));
+    ptrdiff_t pixelStep = next.y * static_cast<ptrdiff_t>(dst.step[0]) + next.x * 3;
+
+    cv::parallel_for_(cv::Range(0, dst.rows), [&](const cv::Range& range) {
+        std::vector<uint16_t> acc(static_cast<size_t>(src.cols) * 3);
+        for (int y = range.start; y < range.end; ++y) {
+            uchar* out = dst.ptr<uchar>(y);
+
+            // Only the letterbox border is cleared, the content is written once
+            if (y < physical.y || y >= physical.y + physical.height) {
+                std::memset(out, 0, static_cast<size_t>(dst.cols) * 3);
+                continue;
+            }
+            std::memset(out, 0, static_cast<size_t>(physical.x) * 3);
+            std::memset(out + (physical.x + physical.width) * 3, 0, static_cast<size_t>(dst.cols - physical.x - physical.width) * 3);
+
+            // Upright rows only line up with scanout rows without rotation
+            if (target.rotation % 180 == 0) {
+                int row = target.toLogical(cv::Point(0, y)).y;
+                verticalPass(src, rows, row - content.y, acc.data(), src.cols * 3);
+                cv::Point first = target.toPhysical(cv::Point(content.x, row));
+                horizontalPass(acc.data(), cols, dst.ptr<uchar>(first.y) + first.x * 3, pixelStep, width);
+            }
+        }
+    });
+
+    if (target.rotation % 180 != 0) {
+        // Portrait layout: each upright row becomes a scanout column, written in the same pass
+        cv::parallel_for_(cv::Range(0, height), [&](const cv::Range& range) {
+            std::vector<uint16_t> acc(static_cast<size_t>(src.cols) * 3);
+            for (int y = range.start; y < range.end; ++y) {
+                verticalPass(src, rows, y, acc.data(), src.cols * 3);
+                cv::Point first = target.toPhysical(cv::Point(content.x, content.y + y));
+                horizontalPass(acc.data(), cols, dst.ptr<uchar>(first.y) + first.x * 3, pixelStep, width);
+            }
+        });
+    }
+
+    return content;
+}
+
+void blendMask(cv::Mat& dst, const cv::Mat& mask, cv::Point origin, const cv::Scalar& color, double opacity)
+{
+    CV_Assert(dst.type() == CV_8UC3 && mask.type() == CV_8UC1);
+
+    cv::Rect area = cv::Rect(origin.x, origin.y, mask.cols, mask.rows) & cv::Rect(0, 0, dst.cols, dst.rows);
+    if (area.empty()) return;
+
+    const uchar colorB = cv::saturate_cast<uchar>(color[0]);
+    const uchar colorG = cv::saturate_cast<uchar>(color[1]);
+    const uchar colorR = cv::saturate_cast<uchar>(color[2]);
+    // Q8 opacity, a = mask * opacity stays within 8 bits
+    const unsigned scale = static_cast<unsigned>(std::lround(std::max(0.0, std::min(1.0, opacity)) * 256));
+
+    for (int y = area.y; y < area.y + area.height; ++y) {
+        const uchar* alpha = mask.ptr<uchar>(y - origin.y) + (area.x - origin.x);
+        uchar* out = dst.ptr<uchar>(y) + area.x * 3;
+        int x = 0;
+
+#if CV_SIMD
+        const int lanes = lanesU8();
+        const cv::v_uint16 full = cv::vx_setall_u16(255), round = cv::vx_setall_u16(128);
+        const cv::v_uint16 b16 = cv::vx_setall_u16(colorB), g16 = cv::vx_setall_u16(colorG), r16 = cv::vx_setall_u16(colorR);
+        const cv::v_uint16 scale16 = cv::vx_setall_u16(static_cast<uint16_t>(scale));
+        for (; x <= area.width - lanes; x += lanes) {
+            cv::v_uint16 aLow, aHigh;
+            cv::v_expand(cv::vx_load(alpha + x), aLow, aHigh);
+            aLow = cv::v_mul_wrap(aLow, scale16) >> 8;
+            aHigh = cv::v_mul_wrap(aHigh, scale16) >> 8;
+            cv::v_uint16 invLow = full - aLow, invHigh = full - aHigh;
+
+            cv::v_uint8 b, g, r;
+            cv::v_load_deinterleave(out + x * 3, b, g, r);
+
+            // (color * a + pixel * (255 - a)) / 255, rounded, in 16 bits
+            auto blend = [&](const cv::v_uint8& channel, const cv::v_uint16& value) {
+                cv::v_uint16 low, high;
+                cv::v_expand(channel, low, high);
+                low = cv::v_mul_wrap(value, aLow) + cv::v_mul_wrap(low, invLow) + round;
+                high = cv::v_mul_wrap(value, aHigh) + cv::v_mul_wrap(high, invHigh) + round;
+                low = (low + (low >> 8)) >> 8;
+                high = (high + (high >> 8)) >> 8;
+                return cv::v_pack(low, high);
+            };
+            cv::v_store_interleave(out + x * 3, blend(b, b16), blend(g, g16), blend(r, r16));
+        }
+#endif
+
+        for (; x < area.width; ++x) {
+            unsigned a = (alpha[x] * scale) >> 8;
+            if (a == 0) continue;
+            out[x * 3] = static_cast<uchar>(div255(colorB * a + out[x * 3] * (255 - a)));
+            out[x * 3 + 1] = static_cast<uchar>(div255(colorG * a + out[x * 3 + 1] * (255 - a)));
+            out[x * 3 + 2] = static_cast<uchar>(div255(colorR * a + out[x * 3 + 2] * (255 - a)));
+        }
+    }
+}
+
+cv::Mat roundedRectMask(cv::Size size, int radius)
+{
+    cv::Mat mask(size, CV_8UC1, cv::Scalar(255));
+    radius = std::max(0, std::min(radius, std::min(size.width, size.height) / 2));
+
+    // Coverage from the distance of each pixel center to the corner circle
+    for (int y = 0; y < radius; ++y) {
+        for (int x = 0; x < radius; ++x) {
+            double dx = radius - (x + 0.5);
+            double dy = radius - (y + 0.5);
+            double coverage = std::max(0.0, std::min(1.0, radius - std::sqrt(dx * dx + dy * dy) + 0.5));
+            uchar value = static_cast<uchar>(std::lround(coverage * 255));
+            mask.at<uchar>(y, x) = value;
+            mask.at<uchar>(y, size.width - 1 - x) = value;
+            mask.at<uchar>(size.height - 1 - y, x) = value;
+            mask.at<uchar>(size.height - 1 - y, size.width - 1 - x) = value;
+        }
+    }
+    return mask;
+}
+
+void crossfade(const cv::Mat& from, const cv::Mat& to, int weight, cv::Mat& dst)
+{
+    CV_Assert(from.type() == to.type() && from.size() == to.size() && from.depth() == CV_8U);
+    dst.create(from.size(), from.type());
+    weight = std::max(0, std::min(256, weight));
+
+    // Rows as flat byte runs, the blend does not care about channels
+    const int length = from.cols * from.channels();
+    const uint16_t inverse = static_cast<uint16_t>(256 - weight);
+    for (int y = 0; y < from.rows; ++y) {
+        const uchar* a = from.ptr<uchar>(y);
+        const uchar* b = to.ptr<uchar>(y);
+        uchar* out = dst.ptr<uchar>(y);
+        int x = 0;
+
+#if CV_SIMD
+        const int lanes = lanesU8();
+        const cv::v_uint16 wa = cv::vx_setall_u16(inverse), wb = cv::vx_setall_u16(static_cast<uint16_t>(weight));
+        for (; x <= length - lanes; x += lanes) {
+            cv::v_uint16 aLow, aHigh, bLow, bHigh;
+            cv::v_expand(cv::vx_load(a + x), aLow, aHigh);
+            cv::v_expand(cv::vx_load(b + x), bLow, bHigh);
+            // At most 255 * 256, fits 16 bits
+            cv::v_uint16 low = (cv::v_mul_wrap(aLow, wa) + cv::v_mul_wrap(bLow, wb)) >> 8;
+            cv::v_uint16 high = (cv::v_mul_wrap(aHigh, wa) + cv::v_mul_wrap(bHigh, wb)) >> 8;
+            cv::v_store(out + x, cv::v_pack(low, high));
+        }
+#endif
+
+        for (; x < length; ++x) {
+            out[x] = static_cast<uchar>((a[x] * inverse + b[x] * weight) >> 8);
+        }
+    }
+}
+
+void warpAffine(const cv::Mat& src, const cv::Matx23d& dstToSrc, cv::Mat& dst)
+{
+    CV_Assert(src.type() == CV_8UC3 && dst.type() == CV_8UC3 && !src.empty());
+
+    if (dstToSrc(0, 1) == 0.0 && dstToSrc(1, 0) == 0.0) {
+        warpSeparable(src, dstToSrc, dst);
+    } else if (dstToSrc(0, 0) == 0.0 && dstToSrc(1, 1) == 0.0) {
+        warpTransposed(src, dstToSrc, dst);
+    } else {
+        warpGeneral(src, dstToSrc, dst);
+    }
+}
+
+}
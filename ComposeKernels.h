@@ -0,0 +1,40 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+// Pixel kernels used to build screen frames. They work on CV_8UC3 frames in
+// place and are vectorised with OpenCV's universal intrinsics, so the same
+// code runs with NEON on the Pi and SSE/AVX on a desktop.
+namespace ComposeKernels {
+
+    // Fits src into dst keeping the aspect ratio. The image is area-resampled
+    // straight into the centered content rectangle of dst and only the border
+    // around it is cleared, so dst can be reused without zeroing it first.
+    // With a rotation (see RenderTarget) dst is a scanout frame and src is
+    // laid out upright and turned in the same pass. Returns the content
+    // rectangle in upright coordinates.
+    cv::Rect letterbox(const cv::Mat& src, cv::Mat& dst, int rotation = 0);
+
+    // Blends color into dst through an 8-bit coverage mask placed at origin,
+    // clipped to dst, with the mask scaled by opacity. Used for anti-aliased
+    // overlay text and, with black, to darken the rounded overlay boxes.
+    void blendMask(cv::Mat& dst, const cv::Mat& mask, cv::Point origin, const cv::Scalar& color, double opacity = 1.0);
+
+    // Anti-aliased coverage mask of a rounded rectangle filling size
+    cv::Mat roundedRectMask(cv::Size size, int radius);
+
+    // dst = from * (256 - weight) / 256 + to * weight / 256 with weight in
+    // 0..256. dst is reused when it already has the right size and type.
+    void crossfade(const cv::Mat& from, const cv::Mat& to, int weight, cv::Mat& dst);
+
+    // Bilinear resample of src into all of dst through an affine map from dst
+    // pixel centers to src pixel centers, as cv::warpAffine with
+    // WARP_INVERSE_MAP. Coordinates are Q16 and weights Q8, pixels that map
+    // outside src are black. dst is cut into tiles that run on all cores;
+    // pure scale and translate maps blend the two source rows with SIMD once
+    // per tile row instead of gathering four pixels per output pixel. Maps
+    // with a quarter turn (portrait panels) do the same on a transposed copy
+    // of the source block each tile reads.
+    void warpAffine(const cv::Mat& src, const cv::Matx23d& dstToSrc, cv::Mat& dst);
+
+}
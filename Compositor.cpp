@@ -0,0 +1,106 @@
+#include "Compositor.h"
+#include <algorithm>
+
+Compositor::Compositor(PresentFrame presentFrame, PresentRegion presentRegion)
+: presentFrame(std::move(presentFrame)), presentRegion(std::move(presentRegion))
+{
+}
+
+void Compositor::present(const cv::Mat& frame)
+{
+    if (frame.empty()) return;
+    base = frame;
+    damaged.clear();
+
+    bool anyVisible = std::any_of(layers.begin(), layers.end(), [](const Layer& layer) { return layer.visible; });
+    if (!anyVisible) {
+        // Nothing on top, the frame goes out as it is
+        presentFrame(base);
+        return;
+    }
+
+    base.copyTo(composed);
+    drawLayers(cv::Rect(0, 0, base.cols, base.rows));
+    presentFrame(composed);
+}
+
+int Compositor::addLayer(DrawLayer draw)
+{
+    Layer layer;
+    layer.draw = std::move(draw);
+    layers.push_back(layer);
+    return static_cast<int>(layers.size()) - 1;
+}
+
+void Compositor::showLayer(int id, const cv::Rect& bounds)
+{
+    Layer& layer = layers.at(id);
+    if (layer.visible) {
+        damage(layer.bounds);
+    }
+    layer.bounds = bounds;
+    layer.visible = true;
+    damage(bounds);
+}
+
+void Compositor::hideLayer(int id)
+{
+    Layer& layer = layers.at(id);
+    if (!layer.visible) return;
+    layer.visible = false;
+    damage(layer.bounds);
+}
+
+void Compositor::damage(const cv::Rect& rect)
+{
+    cv::Rect area = rect & cv::Rect(0, 0, base.cols, base.rows);
+    if (area.empty()) return;
+
+    // Overlapping rectangles are merged so no pixel is blended twice
+    for (size_t i = 0; i < damaged.size();) {
+        if ((damaged[i] & area).empty()) {
+            ++i;
+            continue;
+        }
+        area |= damaged[i];
+        damaged.erase(damaged.begin() + i);
+        i = 0;
+    }
+    damaged.push_back(area);
+}
+
+void Compositor::drawLayers(const cv::Rect& area)
+{
+    for (Layer& layer : layers) {
+        cv::Rect clip = layer.bounds & area;
+        if (!layer.visible || clip.empty()) continue;
+        cv::Mat region = composed(clip);
+        layer.draw(region, clip.tl());
+    }
+}
+
+size_t Compositor::heldBytes() const
+{
+    return composed.total() * composed.elemSize();
+}
+
+void Compositor::flush()
+{
+    if (damaged.empty() || base.empty()) return;
+
+    if (composed.size() != base.size() || composed.type() != base.type()) {
+        composed.create(base.size(), base.type());
+    }
+
+    std::vector<cv::Rect> areas;
+    areas.swap(damaged);
+    for (const cv::Rect& area : areas) {
+        base(area).copyTo(composed(area));
+        drawLayers(area);
+        if (!presentRegion(composed, area)) {
+            // The rest of composed is stale, build and show the whole frame instead
+            present(base);
+            return;
+        }
+    }
+}
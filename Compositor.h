@@ -0,0 +1,56 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+// Keeps what is on screen as a base frame plus overlay layers, like the
+// touch feedback. Showing, moving or hiding a layer only damages its old and
+// new bounds; flush() re-blends the damaged rectangles from the base and the
+// layers and presents just those regions. Full frames (slides, fade steps,
+// motion frames) go through present() so visible layers stay on top.
+class Compositor {
+public:
+    using PresentFrame = std::function<void(const cv::Mat&)>;
+    // Presents part of a frame, false when only full frames can be shown
+    using PresentRegion = std::function<bool(const cv::Mat&, const cv::Rect&)>;
+    // Draws a layer into region, whose top-left corner is origin in frame coordinates
+    using DrawLayer = std::function<void(cv::Mat& region, cv::Point origin)>;
+
+    Compositor(PresentFrame presentFrame, PresentRegion presentRegion);
+
+    // Shows a new base frame with the visible layers on top
+    void present(const cv::Mat& frame);
+
+    // Adds a hidden layer, layers added later are drawn on top
+    int addLayer(DrawLayer draw);
+
+    // Shows the layer inside bounds, again after its content changed, or moved
+    void showLayer(int id, const cv::Rect& bounds);
+    void hideLayer(int id);
+
+    // Re-blends and presents the damaged rectangles
+    void flush();
+
+    // The composed frame, base is the caller's
+    size_t heldBytes() const;
+
+private:
+    struct Layer {
+        DrawLayer draw;
+        cv::Rect bounds;
+        bool visible = false;
+    };
+
+    void damage(const cv::Rect& rect);
+    void drawLayers(const cv::Rect& area);
+
+    PresentFrame presentFrame;
+    PresentRegion presentRegion;
+    std::vector<Layer> layers;
+    std::vector<cv::Rect> damaged;
+
+    // base is the caller's frame, composed only holds base plus layers where they were blended
+    cv::Mat base;
+    cv::Mat composed;
+};
@@ -0,0 +1,120 @@
+#include "Crossfade.h"
+#include "ComposeKernels.h"
+#include <algorithm>
+#include <iostream>
+
+namespace {
+    double msSince(std::chrono::steady_clock::time_point since, std::chrono::steady_clock::time_point now) {
+        return std::chrono::duration<double, std::milli>(now - since).count();
+    }
+}
+
+Crossfade::Crossfade(std::function<void(const cv::Mat&)> present)
+: present(std::move(present))
+{
+}
+
+void Crossfade::configure(int durationMs, int fps)
+{
+    duration = std::chrono::milliseconds(std::max(0, durationMs));
+    period = std::chrono::microseconds(1000000 / std::max(1, fps));
+}
+
+void Crossfade::prepare(const cv::Mat& outgoing)
+{
+    if (active) {
+        // Fade on from whatever step is on screen right now
+        if (!blended.empty()) {
+            std::swap(from, blended);
+        }
+        cancel();
+        return;
+    }
+    outgoing.copyTo(from);
+}
+
+void Crossfade::start(const cv::Mat& incoming)
+{
+    if (duration.count() == 0 || from.empty() || from.size() != incoming.size() || from.type() != incoming.type()) {
+        present(incoming);
+        return;
+    }
+
+    to = incoming;
+    active = true;
+    startTime = std::chrono::steady_clock::now();
+    lastShown = startTime;
+    lastStep = 0;
+    shownSteps = 0;
+    droppedSteps = 0;
+    workTotalMs = 0.0;
+    workMaxMs = 0.0;
+    intervalMaxMs = 0.0;
+}
+
+bool Crossfade::isActive() const {
+    return active;
+}
+
+void Crossfade::cancel()
+{
+    active = false;
+    to.release();
+}
+
+size_t Crossfade::heldBytes() const
+{
+    return from.total() * from.elemSize() + blended.total() * blended.elemSize();
+}
+
+int Crossfade::msUntilNextStep() const
+{
+    if (!active) return -1;
+    auto deadline = startTime + period * (lastStep + 1);
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    return std::max(0, static_cast<int>(remaining.count()));
+}
+
+void Crossfade::tick()
+{
+    if (!active) return;
+
+    auto now = std::chrono::steady_clock::now();
+    long step = static_cast<long>((now - startTime) / period);
+    if (step <= lastStep) return;
+
+    // Steps whose deadline already passed are not worth showing anymore
+    droppedSteps += static_cast<int>(step - lastStep - 1);
+    lastStep = step;
+
+    auto progress = std::chrono::duration_cast<std::chrono::microseconds>(period * step);
+    int weight = static_cast<int>(progress.count() * 256 / std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+    if (weight >= 256) {
+        finish();
+        return;
+    }
+
+    ComposeKernels::crossfade(from, to, weight, blended);
+    present(blended);
+
+    auto done = std::chrono::steady_clock::now();
+    double work = msSince(now, done);
+    workTotalMs += work;
+    workMaxMs = std::max(workMaxMs, work);
+    intervalMaxMs = std::max(intervalMaxMs, msSince(lastShown, now));
+    lastShown = now;
+    shownSteps++;
+}
+
+void Crossfade::finish()
+{
+    present(to);
+    active = false;
+    to.release();
+
+    double seconds = msSince(startTime, std::chrono::steady_clock::now()) / 1000.0;
+    std::cout << "Crossfade: " << shownSteps << " steps shown, " << droppedSteps << " dropped, "
+              << (seconds > 0 ? (shownSteps + 1) / seconds : 0.0) << " fps, blend+present "
+              << (shownSteps ? workTotalMs / shownSteps : 0.0) << " ms avg / " << workMaxMs << " ms max, longest gap "
+              << intervalMaxMs << " ms" << std::endl;
+}
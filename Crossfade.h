@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <opencv2/opencv.hpp>
+
+// Crossfades from the frame on screen to the next slide. Blend steps are
+// paced on a fixed frame period from the start of the fade: every step has
+// a deadline, and when the loop wakes up late the steps that are already
+// over are skipped instead of being shown late. The blend goes into a reused
+// buffer and is handed to the present function.
+class Crossfade {
+public:
+    explicit Crossfade(std::function<void(const cv::Mat&)> present);
+
+    // A duration of 0 switches slides with a hard cut
+    void configure(int durationMs, int fps);
+
+    // Keeps a copy of the outgoing frame, call before the next slide overwrites it
+    void prepare(const cv::Mat& outgoing);
+
+    // Starts fading to incoming, which must stay valid until the fade ends
+    void start(const cv::Mat& incoming);
+
+    bool isActive() const;
+
+    // Ends the fade without showing the rest, e.g. when the user zooms
+    void cancel();
+
+    // Presents the current step if its deadline has come
+    void tick();
+
+    // Milliseconds until the next step is due, -1 without a fade
+    int msUntilNextStep() const;
+
+    // Outgoing copy and blend buffer, incoming is the caller's
+    size_t heldBytes() const;
+
+private:
+    void finish();
+
+    std::function<void(const cv::Mat&)> present;
+    std::chrono::milliseconds duration{800};
+    std::chrono::microseconds period{33333};
+
+    bool active = false;
+    cv::Mat from;
+    cv::Mat to;
+    cv::Mat blended;
+    std::chrono::steady_clock::time_point startTime;
+    long lastStep = 0;
+
+    // Frame-time statistics of the running fade
+    int shownSteps = 0;
+    int droppedSteps = 0;
+    double workTotalMs = 0.0;
+    double workMaxMs = 0.0;
+    double intervalMaxMs = 0.0;
+    std::chrono::steady_clock::time_point lastShown;
+};
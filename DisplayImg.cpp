@@ -5,6 +5,12 @@
 using json = nlohmann::json;
 namespace fs = std::filesystem;
 
+namespace {
+    size_t slideBytes(const SlideFrame& slide) {
+        return slide.frame.total() * slide.frame.elemSize() + slide.motionSource.total() * slide.motionSource.elemSize();
+    }
+}
+
 DisplayImg::DisplayImg()
 : stopThread(false)
 {
@@ -18,8 +24,20 @@ DisplayImg::DisplayImg()
 DisplayImg::~DisplayImg()
 {
     stopThread = true;
-    if (preloadThread.joinable()){
-        preloadThread.join();
+    {
+        std::lock_guard<std::mutex> lock(inFlightMutex);
+        inFlightToken.cancel();
+    }
+    {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        for (auto& load : historyLoads) {
+            load.second.cancel();
+        }
+    }
+    // Background tasks of this object may still be queued or running
+    {
+        std::unique_lock<std::mutex> lock(readyMutex);
+        readyCondVar.wait(lock, [this]() { return tasksInFlight == 0; });
     }
     std::cout << "DisplayImg object destroyed." << std::endl;
 }
@@ -34,7 +52,15 @@ void DisplayImg::loadVisitedPathsFromJson() {
             auto list = j.value("visitedPaths", std::vector<std::string>{});
             std::lock_guard<std::mutex> lock(visitedPathsMutex);
             visitedPaths.insert(list.begin(), list.end());
+            visitedCount = visitedPaths.size();
             std::cout << "Loaded " << visitedPaths.size() << " visited paths from db.json\n";
+
+            history = j.value("history", std::vector<std::string>{});
+            if (history.size() > maxHistory) {
+                history.erase(history.begin(), history.end() - maxHistory);
+            }
+            historyPosition = static_cast<int>(history.size()) - 1;
+            std::cout << "Loaded " << history.size() << " history entries from db.json\n";
         } catch (const std::exception& e) {
             std::cerr << "Failed to parse db.json: " << e.what() << std::endl;
         }
@@ -53,28 +79,57 @@ void DisplayImg::setShowDate(bool value){
 }
 
 std::vector<std::string> DisplayImg::findImages(){
-    imagePaths.clear();
     std::vector<std::string> imageExtensions = { ".jpg", ".jpeg", ".png", ".bmp", ".tiff" };
-
-    if(!fs::exists(folderPath)){
+    imageExtensions.insert(imageExtensions.end(), rawExtensions.begin(), rawExtensions.end());
+
+    // Every directory is listed through the I/O service. When the source
+    // stops answering halfway, the list from the last scan is kept.
+    IoService& io = IoService::instance();
+    bool found = false;
+    if (!io.exists(folderPath, found)) {
+        std::cout << "Folderpath: " << folderPath << " not reachable, keeping " << imagePaths.size() << " images" << std::endl;
+        return imagePaths;
+    }
+    if(!found){
         std::cout <<"Folderpath: " << folderPath << " not found."<<std::endl;
+        imagePaths.clear();
+        return imagePaths;
+    }
+
+    std::vector<IoService::DirEntry> folders;
+    if (!io.listDirectory(folderPath, folders)) {
+        std::cout << "Folderpath: " << folderPath << " not reachable, keeping " << imagePaths.size() << " images" << std::endl;
         return imagePaths;
     }
 
-    for (const auto& entry : fs::directory_iterator(folderPath)) {
-        if (entry.is_directory()) {
-            std::string folderName = entry.path().filename().string();
+    std::vector<std::string> paths;
+    for (const auto& entry : folders) {
+        if (entry.directory) {
+            std::string folderName = fs::path(entry.path).filename().string();
             
             // Check if folder is in the folderFilter
             if (folderFilter.empty() || std::find(folderFilter.begin(), folderFilter.end(), folderName) != folderFilter.end()) {
-                // Scan this subfolder
-                for (const auto& fileEntry : fs::recursive_directory_iterator(entry.path())) {
-                    if (fileEntry.is_regular_file()) {
-                        std::string ext = fileEntry.path().extension().string();
-                        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower); // lowercase extension
-                        
-                        if (std::find(imageExtensions.begin(), imageExtensions.end(), ext) != imageExtensions.end()) {
-                            imagePaths.push_back(fileEntry.path().string());
+                // Scan this subfolder, symlinked directories below it are not followed
+                std::vector<std::string> pending = { entry.path };
+                while (!pending.empty()) {
+                    std::string directory = pending.back();
+                    pending.pop_back();
+
+                    std::vector<IoService::DirEntry> entries;
+                    if (!io.listDirectory(directory, entries)) {
+                        std::cout << "Scan of " << directory << " timed out, keeping " << imagePaths.size() << " images" << std::endl;
+                        return imagePaths;
+                    }
+                    for (const auto& fileEntry : entries) {
+                        if (fileEntry.directory && !fileEntry.symlink) {
+                            pending.push_back(fileEntry.path);
+                        } else if (fileEntry.regular) {
+                            std::string ext = fs::path(fileEntry.path).extension().string();
+                            std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower); // lowercase extension
+                            
+                            if (std::find(imageExtensions.begin(), imageExtensions.end(), ext) != imageExtensions.end()) {
+                                paths.push_back(fileEntry.path);
+                            }
                         }
                     }
                 }
@@ -82,74 +137,326 @@ std::vector<std::string> DisplayImg::findImages(){
         }
     }
 
+    imagePaths = paths;
+    removeRawDuplicates();
+
     return imagePaths;
 }
 
-void DisplayImg::startPreloading()
+bool DisplayImg::isRawFile(const std::string& filePath) const
 {
-    preloadThread = std::thread(&DisplayImg::preloadThreadFunc, this);
+    std::string ext = fs::path(filePath).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return std::find(rawExtensions.begin(), rawExtensions.end(), ext) != rawExtensions.end();
 }
 
-void DisplayImg::preloadThreadFunc()
+void DisplayImg::removeRawDuplicates()
 {
-    std::random_device rd;
-    std::mt19937 gen(rd());
+    // Where a RAW+JPEG pair exists, only keep the camera JPEG
+    std::unordered_set<std::string> developed;
+    for (const auto& path : imagePaths) {
+        if (!isRawFile(path)) {
+            developed.insert(fs::path(path).replace_extension().string());
+        }
+    }
+
+    size_t before = imagePaths.size();
+    imagePaths.erase(std::remove_if(imagePaths.begin(), imagePaths.end(), [&](const std::string& path) {
+        return isRawFile(path) && developed.count(fs::path(path).replace_extension().string()) > 0;
+    }), imagePaths.end());
+
+    if (before != imagePaths.size()) {
+        std::cout << "Skipped " << (before - imagePaths.size()) << " RAW files with a JPEG copy" << std::endl;
+    }
+}
+
+void DisplayImg::startPreloading(Executor& executor)
+{
+    this->executor = &executor;
+
+    // Screen frames for the slots filled first, the render target is known by now
+    size_t slots = 0;
+    readyFrames.prepare([this, &slots](SlideFrame& slot) {
+        if (slots++ < static_cast<size_t>(prefetch.depth())) {
+            slot.frame.create(renderTarget.size, CV_8UC3);
+        }
+    });
+    schedulePreload();
+}
 
-    while (!stopThread)
+void DisplayImg::submit(Executor::Priority priority, std::function<void()> task, Executor::CancelToken token)
+{
     {
-        resetVisitedPathsIfNeeded();
-        {
-            std::unique_lock<std::mutex> lock(queueMutex);
-            if (imageQueue.size() >= bufferSize)
-            {
-                queueCondVar.wait_for(lock, std::chrono::milliseconds(100));
-                continue;
-            }
+        std::lock_guard<std::mutex> lock(readyMutex);
+        tasksInFlight++;
+    }
+    executor->submit(priority, [this, task](const Executor::CancelToken&) {
+        task();
+        // Under the lock, the destructor may be waiting for the last task
+        std::lock_guard<std::mutex> lock(readyMutex);
+        tasksInFlight--;
+        readyCondVar.notify_all();
+    }, token);
+}
+
+void DisplayImg::schedulePreload()
+{
+    if (executor == nullptr || stopThread) return;
+
+    // Slides are prepared one after the other, the ring has a single producer.
+    // A UI waiting for a slide or a switch deadline coming up on an empty
+    // ring makes the preparation interactive work, also one already queued
+    // or running.
+    bool urgent = uiWaiting || deadlineLate;
+    if (preloadScheduled.exchange(true)) {
+        if (urgent) {
+            std::lock_guard<std::mutex> lock(preloadTokenMutex);
+            executor->raise(preloadToken, Executor::Priority::Interactive);
         }
+        return;
+    }
 
-        if (imagePaths.empty())
-            continue;
+    Executor::CancelToken token;
+    {
+        std::lock_guard<std::mutex> lock(preloadTokenMutex);
+        preloadToken = token;
+    }
+    Executor::Priority priority = urgent ? Executor::Priority::Interactive : Executor::Priority::Prefetch;
+    submit(priority, [this]() {
+        preloadRetryAt = 0;
+        if (!stopThread && readyFrames.size() < static_cast<size_t>(prefetch.depth())) {
+            prepareNextSlide();
+        }
+        preloadScheduled = false;
 
-        // Select random unvisited image
-        std::vector<std::string> availableImages;
-        {
-            std::lock_guard<std::mutex> lock(queueMutex);
-            for (const auto& path : imagePaths)
-            {
-                if (visitedPaths.find(path) == visitedPaths.end())
-                {
-                    availableImages.push_back(path);
-                }
-            }
+        // Once the ring holds depth() slides the UI schedules again when it
+        // takes one, after an idle pass the main loop at the retry time
+        if (preloadRetryAt == 0 && readyFrames.size() < static_cast<size_t>(prefetch.depth())) {
+            schedulePreload();
         }
+    }, token);
+}
+
+void DisplayImg::idlePreload(std::chrono::steady_clock::time_point retryAt)
+{
+    preloadRetryAt = retryAt.time_since_epoch().count();
+    if (wakeup) wakeup();
+}
+
+std::chrono::steady_clock::time_point DisplayImg::preloadRetryTime() const
+{
+    auto retryAt = preloadRetryAt.load();
+    if (retryAt == 0) return std::chrono::steady_clock::time_point::max();
+    return std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(retryAt));
+}
 
-        if (availableImages.empty())
+void DisplayImg::checkPreloadRetry()
+{
+    if (preloadRetryAt == 0 || std::chrono::steady_clock::now() < preloadRetryTime()) return;
+    preloadRetryAt = 0;
+    schedulePreload();
+}
+
+void DisplayImg::prepareNextSlide()
+{
+    if (imagePaths.empty())
+    {
+        // The list is only scanned at startup, a taken slide tries again
+        idlePreload(std::chrono::steady_clock::time_point::max());
+        return;
+    }
+
+    resetVisitedPathsIfNeeded();
+    SlideFrame* slot = readyFrames.writeSlot();
+    if (slot == nullptr)
+        return;
+
+    // Source down: keep cycling through what is in memory until it is back
+    if (!IoService::instance().isAvailable())
+    {
+        publishCachedSlide(*slot);
+        return;
+    }
+
+    // Select random unvisited image, no lock needed since visitedPaths is ours
+    std::vector<std::string> availableImages;
+    for (const auto& path : imagePaths)
+    {
+        if (visitedPaths.find(path) == visitedPaths.end())
         {
-            // No unvisited images left
-            std::this_thread::sleep_for(std::chrono::milliseconds(500));
-            continue;
+            availableImages.push_back(path);
         }
+    }
 
-        std::uniform_int_distribution<> distr(0, availableImages.size() - 1);
-        std::string randomPath = availableImages[distr(gen)];
+    if (availableImages.empty())
+    {
+        // Every image shown, with paths in visitedPaths that are gone by now
+        resetVisitedPaths();
+        availableImages = imagePaths;
+    }
 
-        cv::Mat img = cv::imread(randomPath, cv::IMREAD_COLOR);
-        if (!img.empty())
-        {
-            std::lock_guard<std::mutex> lock(queueMutex);
-            imageQueue.push({randomPath, img});
-            visitedPaths.insert(randomPath); // Mark as visited
-            saveVisitedPathToJson(randomPath);
-            queueCondVar.notify_one();
+    std::uniform_int_distribution<> distr(0, availableImages.size() - 1);
+    std::string randomPath = availableImages[distr(gen)];
+
+    // The header first, with the embedded preview when nothing else is ready to be shown
+    ImageHead head;
+    if (!fetchHead(randomPath, readyFrames.empty(), head))
+    {
+        // Source not answering, the image stays unvisited
+        return;
+    }
+
+    // Everything the UI needs is prepared here, right in the ring slot,
+    // it only adds the overlays
+    SlideFrame& slide = *slot;
+    slide.path = randomPath;
+    slide.dateText = formatCaptureDate(head.rawDate);
+    slide.folderName = fs::path(randomPath).parent_path().filename().string();
+    slide.motionSource.release();
+    slide.focus = cv::Point2d();
+
+    // Publish the embedded preview first so a tap can show it right away.
+    // Only worth it when nothing else is ready to be shown.
+    SlideFrame preview;
+    preview.path = slide.path;
+    preview.dateText = slide.dateText;
+    preview.folderName = slide.folderName;
+    if (readyFrames.empty()) {
+        preview.frame = composeFrame(loadPreview(head));
+    }
+    Executor::CancelToken token;
+    {
+        std::lock_guard<std::mutex> lock(inFlightMutex);
+        inFlightPath = randomPath;
+        inFlightPreview = preview;
+        inFlightToken = token;
+    }
+    if (!preview.frame.empty() && wakeup) wakeup();
+
+    // The full resolution decode is dropped as soon as the screen frame
+    // and the motion source exist. A tap past the preview cancels the
+    // token, the decode itself runs to the end but nothing after it.
+    auto loadStart = std::chrono::steady_clock::now();
+    double fetchMs = 0.0;
+    cv::Mat decoded = loadImage(randomPath, head, &fetchMs);
+    auto composeStart = std::chrono::steady_clock::now();
+    if (!token.isCancelled()) {
+        composeFrame(decoded, slide.frame);
+    }
+    if (!token.isCancelled()) {
+        prepareMotion(slide, decoded);
+    }
+    decoded.release();
+    size_t previewBytes = head.preview.capacity();
+    head.preview = std::vector<unsigned char>();
+    MemoryGovernor::instance().releaseTransient(previewBytes);
+
+    bool cancelled = token.isCancelled();
+    bool loaded = !cancelled && !slide.frame.empty();
+    if (loaded)
+    {
+        auto done = std::chrono::steady_clock::now();
+        double loadMs = std::chrono::duration<double, std::milli>(composeStart - loadStart).count();
+        prefetch.addPrepared(fetchMs, std::max(0.0, loadMs - fetchMs), std::chrono::duration<double, std::milli>(done - composeStart).count(), slideBytes(slide));
+    }
+    if (loaded || cancelled)
+    {
+        // An abandoned slide was on screen as a preview, it counts as seen
+        visitedPaths.insert(randomPath); // Mark as visited
+        visitedCount = visitedPaths.size();
+    }
+    if (loaded)
+    {
+        queuedBytes += slideBytes(slide);
+        readyFrames.publish();
+    }
+
+    // Only after the publish, so the UI always finds the slide either
+    // in flight or in the ring
+    {
+        std::lock_guard<std::mutex> lock(inFlightMutex);
+        if (inFlightPath == randomPath) {
+            inFlightPath.clear();
+            inFlightPreview = SlideFrame();
         }
-        else
-        {
-            std::cerr << "Failed to load image: " << randomPath << std::endl;
+    }
+    if (wakeup) wakeup();
+
+    if (loaded || cancelled)
+    {
+        saveVisitedPathToJson(randomPath);
+    }
+    if (cancelled)
+    {
+        std::cout << "Abandoned decode of " << randomPath << std::endl;
+    }
+    else if (!loaded)
+    {
+        std::cerr << "Failed to load image: " << randomPath << std::endl;
+    }
+}
+
+void DisplayImg::publishCachedSlide(SlideFrame& slot)
+{
+    // Any slide still in memory but the one served last
+    SlideFrame cached;
+    {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        std::vector<const SlideFrame*> candidates;
+        for (const auto& entry : historyFrames) {
+            if (!entry.second.frame.empty() && entry.first != lastCachedPath) {
+                candidates.push_back(&entry.second);
+            }
+        }
+        if (!candidates.empty()) {
+            std::uniform_int_distribution<size_t> distr(0, candidates.size() - 1);
+            cached = *candidates[distr(gen)];
         }
     }
+    if (cached.frame.empty()) {
+        // Nothing to show until the source is back, the event loop retries
+        idlePreload(IoService::instance().nextAttempt());
+        return;
+    }
+
+    std::cout << "Source down, showing " << cached.path << " from memory" << std::endl;
+    lastCachedPath = cached.path;
+    slot = cached;
+    queuedBytes += slideBytes(slot);
+    readyFrames.publish();
+    if (wakeup) wakeup();
 }
 
 void DisplayImg::saveVisitedPathToJson(const std::string& newPath) {
+    // Written in the background, all paths queued until the write starts go in one go
+    std::lock_guard<std::mutex> lock(visitedPathsMutex);
+    dbAppends.push_back(newPath);
+    scheduleDbWrite();
+}
+
+void DisplayImg::scheduleDbWrite() {
+    // Called with visitedPathsMutex held
+    if (dbWriteScheduled) return;
+    dbWriteScheduled = true;
+    submit(Executor::Priority::Maintenance, [this]() { writeVisitedPaths(); });
+}
+
+void DisplayImg::writeVisitedPaths() {
+    // One writer at a time, so the batches reach the file in order
+    std::lock_guard<std::mutex> fileLock(dbFileMutex);
+    std::vector<std::string> appends;
+    std::vector<std::string> historyAppends;
+    bool reset;
+    {
+        std::lock_guard<std::mutex> lock(visitedPathsMutex);
+        appends.swap(dbAppends);
+        historyAppends.swap(dbHistoryAppends);
+        reset = dbReset;
+        dbReset = false;
+        dbWriteScheduled = false;
+    }
+    if (!reset && appends.empty() && historyAppends.empty()) return;
+
     std::ifstream inFile(dbFilePath);
     json j;
 
@@ -166,386 +473,1285 @@ void DisplayImg::saveVisitedPathToJson(const std::string& newPath) {
         j["visitedPaths"] = json::array();
     }
 
+    if (reset || !j["visitedPaths"].is_array()) {
+        j["visitedPaths"] = json::array();  // Empty the array
+    }
+
     // Append only if not already present
     auto& visitedArray = j["visitedPaths"];
-    if (std::find(visitedArray.begin(), visitedArray.end(), newPath) == visitedArray.end()) {
-        visitedArray.push_back(newPath);
-
-        std::ofstream outFile(dbFilePath);
-        if (outFile.is_open()) {
-            outFile << j.dump(4);
-            outFile.close();
-        } else {
-            std::cerr << "Error: Cannot write to db.json\n";
+    for (const auto& newPath : appends) {
+        if (std::find(visitedArray.begin(), visitedArray.end(), newPath) == visitedArray.end()) {
+            visitedArray.push_back(newPath);
         }
     }
+
+    // The display history keeps its order and repeats, only its length is bounded
+    if (!j["history"].is_array()) {
+        j["history"] = json::array();
+    }
+    auto& historyArray = j["history"];
+    for (const auto& path : historyAppends) {
+        historyArray.push_back(path);
+    }
+    if (historyArray.size() > maxHistory) {
+        historyArray.erase(historyArray.begin(), historyArray.begin() + (historyArray.size() - maxHistory));
+    }
+
+    std::ofstream outFile(dbFilePath);
+    if (outFile.is_open()) {
+        outFile << j.dump(4); // Pretty print with 4-space indent
+        outFile.close();
+    } else {
+        std::cerr << "Error: Cannot write to db.json\n";
+    }
 }
 
 void DisplayImg::resetVisitedPathsIfNeeded()
 {
     if (visitedPaths.size() == imagePaths.size())
     {
-        std::cout << "All images have been visited. Resetting visitedPaths." << std::endl;
-        visitedPaths.clear(); // Reset visited paths after all images are visited
+        resetVisitedPaths();
+    }
+}
 
-        // Clear visitedPaths in db.json
-        try
-        {
-            std::ifstream inFile("db.json");
-            if (!inFile.is_open()) {
-                std::cerr << "Failed to open db.json for reading." << std::endl;
-                return;
-            }
+void DisplayImg::resetVisitedPaths()
+{
+    std::cout << "All images have been visited. Resetting visitedPaths." << std::endl;
+    visitedPaths.clear(); // Reset visited paths after all images are visited
+    visitedCount = 0;
+
+    // Clear visitedPaths in db.json, paths queued before the reset are dropped
+    std::lock_guard<std::mutex> lock(visitedPathsMutex);
+    dbAppends.clear();
+    dbReset = true;
+    scheduleDbWrite();
+}
 
-            nlohmann::json db;
-            inFile >> db;
-            inFile.close();
+cv::Mat DisplayImg::getPrevImage(){
+    std::cout <<" " <<std::endl; 
+    clearZoom();
+    noteNavigation(-1);
+    if (waitingHistory && historyWait.direction < 0) {
+        // The entry before is still loading, only the UI thread sets direction
+        return cv::Mat();
+    }
+    cancelNextImage();
 
-            db["visitedPaths"] = nlohmann::json::array();  // Empty the array
+    if (historyPosition <= 0) {
+        return cv::Mat();
+    }
 
-            std::ofstream outFile("db.json");
-            if (!outFile.is_open()) {
-                std::cerr << "Failed to open db.json for writing." << std::endl;
-                return;
-            }
+    std::cout << "Prev: Index " << historyPosition - 1 << " of " << history.size() << std::endl;
+    return showHistoryEntry(historyPosition - 1, -1);
+}
+cv::Mat DisplayImg::getNextImage(bool userInitiated)
+{
+    std::cout <<" " <<std::endl; 
+    clearZoom();
+    if (userInitiated) {
+        noteNavigation(1);
+    }
+
+    // Swallow the full decode of a preview that is still on screen
+    cv::Mat refined;
+    refineCurrentImage(refined);
 
-            outFile << db.dump(4); // Pretty print with 4-space indent
-            outFile.close();
+    if (historyPosition + 1 < static_cast<int>(history.size())) {
+        std::cout << "Next: Index: " << historyPosition + 1 << " of " << history.size() << std::endl;
+        cv::Mat shown = showHistoryEntry(historyPosition + 1, 1);
+        if (!shown.empty() || waitingForNext) {
+            waitingUserInitiated = userInitiated;
+            return shown;
         }
-        catch (const std::exception& e)
+    }
+
+    std::cout << "NEXT: FROM QUEUE"  << std::endl;
+
+    // A tap past a preview: its full decode is not needed any more
+    if (userInitiated && !pendingRefinePath.empty())
+    {
+        std::lock_guard<std::mutex> lock(inFlightMutex);
+        if (inFlightPath == pendingRefinePath)
         {
-            std::cerr << "Error updating db.json: " << e.what() << std::endl;
+            std::cout << "NEXT: ABANDON DECODE " << inFlightPath << std::endl;
+            inFlightToken.cancel();
+            inFlightPath.clear();
+            inFlightPreview = SlideFrame();
         }
-    
+        pendingRefinePath.clear();
     }
-}
 
-cv::Mat DisplayImg::getPrevImage(){
-    std::cout <<" " <<std::endl; 
-    if(pastImages.empty()){
-        return cv::Mat();
+    cv::Mat next = takeNextImage(userInitiated);
+    if (next.empty())
+    {
+        // Nothing ready, the slide on screen stays until resumeNextImage()
+        std::cout << "NEXT: NOT READY" << std::endl;
+        waitingForNext = true;
+        waitingUserInitiated = userInitiated;
+        stallStart = std::chrono::steady_clock::now();
+        uiWaiting = true;
+        schedulePreload();
     }
+    return next;
+}
 
+bool DisplayImg::isWaitingForNext() const
+{
+    return waitingForNext;
+}
 
-    if (currentBufferIndex >= static_cast<int>(pastImages.size())) {
-        currentBufferIndex = static_cast<int>(pastImages.size()) - 1;
+bool DisplayImg::isNextReady()
+{
+    if (!waitingForNext) return false;
+    if (waitingHistory) {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        return historyWait.done;
     }
+    if (!readyFrames.empty()) return true;
+    if (!waitingUserInitiated) return false;
 
-    currentBufferIndex--;
+    std::lock_guard<std::mutex> lock(inFlightMutex);
+    return !inFlightPreview.frame.empty() && inFlightPath != pendingRefinePath;
+}
+
+cv::Mat DisplayImg::resumeNextImage()
+{
+    if (!waitingForNext) return cv::Mat();
+    if (waitingHistory) return resumeHistoryEntry();
 
-    if (currentBufferIndex < 0) {
-        currentBufferIndex = 0;
+    cv::Mat next = takeNextImage(waitingUserInitiated);
+    if (!next.empty()) {
+        endStall("shown");
     }
+    return next;
+}
 
-    
+void DisplayImg::cancelNextImage()
+{
+    if (waitingHistory) {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        historyWait.token.cancel();
+        if (!historyWait.done) historyLoads.erase(historyWait.path);
+        historyWait = HistoryWait();
+        waitingHistory = false;
+    }
+    if (waitingForNext) {
+        endStall("given up");
+    }
+}
+
+void DisplayImg::endStall(const char* outcome)
+{
+    waitingForNext = false;
+    uiWaiting = false;
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stallStart).count();
+    stallCount++;
+    stallTotalMs += ms;
+    stallMaxMs = std::max(stallMaxMs, ms);
+    std::cout << "Next slide " << outcome << " after " << ms << " ms not ready (" << stallCount << " stalls, "
+              << stallTotalMs << " ms total, " << stallMaxMs << " ms max)" << std::endl;
+}
+
+cv::Mat DisplayImg::takeNextImage(bool userInitiated)
+{
+    if (userInitiated) prefetch.addTap();
+
+    // On a tap, show the embedded preview instead of waiting for the decode
+    if (readyFrames.empty() && userInitiated)
+    {
+        std::unique_lock<std::mutex> lock(inFlightMutex);
+        if (!inFlightPreview.frame.empty() && inFlightPath != pendingRefinePath)
+        {
+            std::cout << "NEXT: EMBEDDED PREVIEW " << inFlightPath << std::endl;
+            currentImg = inFlightPreview;
+            pendingRefinePath = inFlightPath;
+            lock.unlock();
 
-    std::pair<std::string, cv::Mat> pair = pastImages[currentBufferIndex];
-    std::cout << "Prev: Index" << currentBufferIndex << std::endl;
+            addToHistory(currentImg);
+            return showImage(currentImg);
+        }
+    }
+
+    SlideFrame* slot = readyFrames.readSlot();
+    if (slot == nullptr)
+    {
+        return cv::Mat();
+    }
 
-    return showImage(pair);
-    
+    // The slot gets the previous slide back. Its frames go back to the
+    // pool, the slot may not be written again for a while with the ring
+    // filled only up to the prefetch depth.
+    std::swap(currentImg, *slot);
+    queuedBytes -= slideBytes(currentImg);
+    slot->frame.release();
+    slot->motionSource.release();
+    readyFrames.release();
+    schedulePreload();
+
+    addToHistory(currentImg);
+    std::cout << "Index "  << historyPosition << " Size: " << history.size() << std::endl;
+    return showImage(currentImg);
 }
-cv::Mat DisplayImg::getNextImage()
+
+cv::Mat DisplayImg::showHistoryEntry(int position, int direction)
 {
-    std::cout <<" " <<std::endl; 
-    if(currentBufferIndex < pastImages.size()-1 && !pastImages.empty()){
+    if (position < 0 || position >= static_cast<int>(history.size())) {
+        return cv::Mat();
+    }
 
-        currentBufferIndex++;
-        auto pair = pastImages[currentBufferIndex];
-        std::cout << "Next: Index: " << currentBufferIndex << std::endl;
+    std::string path = history[position];
+    SlideFrame slide;
+    {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        auto it = historyFrames.find(path);
+        if (it != historyFrames.end()) {
+            slide = it->second;
+        }
+    }
+    if (!slide.frame.empty()) {
+        historyPosition = position;
+        currentImg = slide;
+        prefetchHistory();
+        return showImage(currentImg);
+    }
 
-        return showImage(pair);
-    }else{
-        std::cout << "NEXT: FROM QUEUE"  << std::endl;
-        std::unique_lock<std::mutex> lock(queueMutex);
-        if (imageQueue.empty())
-        {
-            queueCondVar.wait(lock, [this]() { return !imageQueue.empty() || stopThread; });
+    // Not prefetched: a NAS read and a decode, not on the UI thread. The
+    // slide on screen stays until resumeNextImage() like for the queue.
+    std::cout << "History: " << path << " was not prefetched, loading it" << std::endl;
+    Executor::CancelToken token;
+    {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        auto load = historyLoads.find(path);
+        if (load != historyLoads.end()) {
+            load->second.cancel();
         }
+        historyLoads[path] = token;
+        historyWait = HistoryWait();
+        historyWait.path = path;
+        historyWait.position = position;
+        historyWait.direction = direction;
+        historyWait.token = token;
+    }
+    waitingHistory = true;
+    if (!waitingForNext) {
+        waitingForNext = true;
+        waitingUserInitiated = false;
+        stallStart = std::chrono::steady_clock::now();
+    }
 
-        if (!imageQueue.empty())
+    submit(Executor::Priority::Interactive, [this, path, token]() {
+        if (token.isCancelled()) return;
+        bool unreachable = false;
+        SlideFrame slide = loadHistorySlide(path, token, &unreachable);
         {
+            std::lock_guard<std::mutex> lock(historyMutex);
+            if (token.isCancelled()) return;
+            historyLoads.erase(path);
+            if (!slide.frame.empty()) {
+                historyFrames[path] = slide;
+            }
+            historyWait.slide = slide;
+            historyWait.unreachable = unreachable;
+            historyWait.done = true;
+        }
+        if (wakeup) wakeup();
+    });
+    return cv::Mat();
+}
 
-            currentImg = imageQueue.front();
-            imageQueue.pop();
-
-            if(pastImages. size() >= prevImageBufferSize){
-                pastImages.pop_front();
+cv::Mat DisplayImg::resumeHistoryEntry()
+{
+    HistoryWait wait;
+    {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        if (!historyWait.done) return cv::Mat();
+        wait = historyWait;
+        historyWait = HistoryWait();
+    }
+    waitingHistory = false;
+
+    cv::Mat shown;
+    if (!wait.slide.frame.empty()) {
+        historyPosition = wait.position;
+        currentImg = wait.slide;
+        prefetchHistory();
+        shown = showImage(currentImg);
+    } else {
+        // Entries whose file is gone are dropped on the way
+        int position = wait.position;
+        if (wait.unreachable) {
+            // Source down, the entry stays for when it is back
+            std::cerr << "History: " << wait.path << " not in memory and the source is not answering" << std::endl;
+            position += wait.direction < 0 ? -1 : 1;
+        } else {
+            std::cerr << "History entry no longer loads: " << wait.path << std::endl;
+            history.erase(history.begin() + position);
+            if (wait.direction < 0) {
+                historyPosition--;
+                position--;
             }
-            pastImages.push_back(currentImg);
-            currentBufferIndex = pastImages.size() - 1;
-            std::cout << "Index"  << currentBufferIndex << " Size: " << pastImages.size() << std::endl;
+        }
 
-            return showImage(currentImg);
+        shown = showHistoryEntry(position, wait.direction);
+        if (shown.empty() && waitingHistory) {
+            return shown; // the next entry is loading
         }
-        else
-        {
-            return cv::Mat();
+        if (shown.empty() && wait.direction > 0) {
+            // Past the end of the history, the wait goes on for the queue
+            shown = takeNextImage(waitingUserInitiated);
+            if (shown.empty()) {
+                uiWaiting = true;
+                schedulePreload();
+                return shown;
+            }
         }
     }
+
+    endStall(shown.empty() ? "given up" : "shown");
+    return shown;
 }
 
-cv::Mat DisplayImg::showImage(std::pair<std::string, cv::Mat> pair){
-    cv::Mat img = pair.second; 
-    std::string filePath = pair.first;
-    if (!img.empty())
+void DisplayImg::addToHistory(const SlideFrame& slide)
+{
+    history.push_back(slide.path);
+    if (history.size() > maxHistory) {
+        history.erase(history.begin());
+    }
+    historyPosition = static_cast<int>(history.size()) - 1;
+
+    {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        SlideFrame& still = historyFrames[slide.path];
+        still = slide;
+        still.motionSource.release(); // stills only in the history
+    }
     {
-        // Define your desired screen size here
-        int screenWidth = 1920;
-        int screenHeight = 1200;
+        std::lock_guard<std::mutex> lock(visitedPathsMutex);
+        dbHistoryAppends.push_back(slide.path);
+        scheduleDbWrite();
+    }
+    prefetchHistory();
+}
 
-        // Calculate aspect ratios
-        double imgAspect = static_cast<double>(img.cols) / img.rows;
-        double screenAspect = static_cast<double>(screenWidth) / screenHeight;
+SlideFrame DisplayImg::loadHistorySlide(const std::string& path, const Executor::CancelToken& token, bool* unreachable)
+{
+    SlideFrame slide;
+    slide.path = path;
+    slide.folderName = fs::path(path).parent_path().filename().string();
+    ImageHead head;
+    if (!fetchHead(path, false, head)) {
+        if (unreachable != nullptr) *unreachable = true;
+        return slide;
+    }
+    slide.dateText = formatCaptureDate(head.rawDate);
+    if (token.isCancelled()) {
+        return slide;
+    }
 
-        int newWidth, newHeight;
-        if (imgAspect > screenAspect)
-        {
-            // Image is wider
-            newWidth = screenWidth;
-            newHeight = static_cast<int>(screenWidth / imgAspect);
+    cv::Mat decoded = loadImage(path, head, nullptr, unreachable);
+    if (!token.isCancelled()) {
+        slide.frame = composeFrame(decoded);
+    }
+    size_t previewBytes = head.preview.capacity();
+    head.preview = std::vector<unsigned char>();
+    MemoryGovernor::instance().releaseTransient(previewBytes);
+    return slide;
+}
+
+void DisplayImg::noteNavigation(int direction)
+{
+    auto now = std::chrono::steady_clock::now();
+    navigation.emplace_back(now, direction);
+    while (now - navigation.front().first > navigationWindow) {
+        navigation.pop_front();
+    }
+}
+
+void DisplayImg::prefetchHistory()
+{
+    if (executor == nullptr || history.empty()) return;
+
+    // Lookahead grows with the taps in the current direction within the window
+    auto now = std::chrono::steady_clock::now();
+    while (!navigation.empty() && now - navigation.front().first > navigationWindow) {
+        navigation.pop_front();
+    }
+    int direction = navigation.empty() ? 0 : navigation.back().second;
+    int taps = 0;
+    for (const auto& tap : navigation) {
+        if (tap.second == direction) taps++;
+    }
+    int lookahead = std::min(maxHistoryLookahead, minHistoryLookahead + 2 * taps);
+    int behind = direction < 0 ? lookahead : minHistoryLookahead;
+    int ahead = direction > 0 ? lookahead : minHistoryLookahead;
+
+    int count = static_cast<int>(history.size());
+    int first = std::max(0, historyPosition - behind);
+    int last = std::min(count - 1, historyPosition + ahead);
+
+    // Nearest first, in the direction of travel before the other one
+    std::vector<std::string> wanted;
+    wanted.push_back(history[historyPosition]);
+    for (int step = 1; step <= std::max(behind, ahead); ++step) {
+        int forward = historyPosition + step;
+        int backward = historyPosition - step;
+        if (direction < 0) std::swap(forward, backward);
+        if (forward >= first && forward <= last) wanted.push_back(history[forward]);
+        if (backward >= first && backward <= last) wanted.push_back(history[backward]);
+    }
+    // Then the most recent ones, newest first
+    std::vector<std::string> order = wanted;
+    for (int i = count - 1; i >= std::max(0, count - recentHistoryFrames); --i) {
+        order.push_back(history[i]);
+    }
+
+    // As many as fit into the memory limit, always the entry on screen.
+    // Frames not loaded yet are counted at the screen size.
+    std::lock_guard<std::mutex> lock(historyMutex);
+    std::unordered_set<std::string> keep;
+    size_t keptBytes = 0;
+    for (const std::string& path : order) {
+        if (keep.count(path)) continue;
+        auto frame = historyFrames.find(path);
+        size_t bytes = frame != historyFrames.end() ? slideBytes(frame->second) : static_cast<size_t>(renderTarget.size.area()) * 3;
+        if (!keep.empty() && keptBytes + bytes > historyMemoryLimit) break;
+        keep.insert(path);
+        keptBytes += bytes;
+    }
+    for (auto it = historyFrames.begin(); it != historyFrames.end();) {
+        if (keep.count(it->first)) {
+            ++it;
+        } else {
+            it = historyFrames.erase(it);
         }
-        else
-        {
-            // Image is taller
-            newHeight = screenHeight;
-            newWidth = static_cast<int>(screenHeight * imgAspect);
+    }
+    for (auto it = historyLoads.begin(); it != historyLoads.end();) {
+        // The entry the UI waits on is loaded whatever the limit
+        if (keep.count(it->first) || it->first == historyWait.path) {
+            ++it;
+        } else {
+            it->second.cancel();
+            it = historyLoads.erase(it);
         }
+    }
 
-        // Resize the image
-        cv::Mat resizedImg;
-        cv::resize(img, resizedImg, cv::Size(newWidth, newHeight));
+    for (const std::string& path : wanted) {
+        if (!keep.count(path) || historyFrames.count(path) || historyLoads.count(path)) continue;
 
-        // Create a black background image
-        cv::Mat outputImg = cv::Mat::zeros(screenHeight, screenWidth, resizedImg.type());
+        Executor::CancelToken token;
+        historyLoads[path] = token;
+        submit(Executor::Priority::Prefetch, [this, path, token]() {
+            if (token.isCancelled()) return;
+            SlideFrame slide = loadHistorySlide(path, token);
 
-        // Center the resized image onto the black background
-        int x = (screenWidth - newWidth) / 2;
-        int y = (screenHeight - newHeight) / 2;
-        resizedImg.copyTo(outputImg(cv::Rect(x, y, newWidth, newHeight)));
-        
-        if(showDate){
-            writeDate(outputImg, filePath);
-        }
+            std::lock_guard<std::mutex> lock(historyMutex);
+            if (token.isCancelled()) return;
+            historyLoads.erase(path);
+            if (!slide.frame.empty()) {
+                historyFrames[path] = slide;
+            }
+        });
+    }
+}
+
+bool DisplayImg::refineCurrentImage(cv::Mat& img)
+{
+    if (pendingRefinePath.empty()) return false;
 
-        if(showImgCount){
-            showImageCount(outputImg);
+    // In flight first: the preparation task publishes the slide before it
+    // clears inFlightPath, so a slide no longer in flight is in the ring
+    bool inFlight;
+    {
+        std::lock_guard<std::mutex> lock(inFlightMutex);
+        inFlight = inFlightPath == pendingRefinePath;
+    }
+
+    SlideFrame full;
+    SlideFrame* slot = readyFrames.readSlot();
+    if (slot != nullptr && slot->path == pendingRefinePath) {
+        std::swap(full, *slot);
+        queuedBytes -= slideBytes(full);
+        readyFrames.release();
+        schedulePreload();
+    } else if (!inFlight) {
+        // Full decode failed, keep the preview
+        pendingRefinePath.clear();
+        return false;
+    } else {
+        return false;
+    }
+    pendingRefinePath.clear();
+
+    {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        auto it = historyFrames.find(full.path);
+        if (it != historyFrames.end()) {
+            it->second = full;
+            it->second.motionSource.release();
         }
-        
-        return outputImg;
-    }else{
-        return cv::Mat(); 
     }
+    bool onScreen = historyPosition >= 0 && historyPosition < static_cast<int>(history.size()) && history[historyPosition] == full.path;
+    if (currentImg.path == full.path) {
+        currentImg = full;
+    }
+
+    if (!onScreen) return false;
+
+    std::cout << "Refined preview with full decode: " << full.path << std::endl;
+    img = showImage(full);
+    return !img.empty();
 }
 
-void DisplayImg::showImageCount(cv::Mat& mat){
-    if (mat.empty()) return; // Safety check
+cv::Mat DisplayImg::loadImage(const std::string& filePath, const ImageHead& head, double* fetchMs, bool* unreachable)
+{
+    if (isRawFile(filePath)) {
+        return decodeRawPreview(filePath, head);
+    }
 
-    // 1. Prepare the text
-    std::string countText = std::to_string(visitedPaths.size()) + "/" + std::to_string(imagePaths.size());
+    // The whole file in one call to the source, decoded from memory
+    auto fetchStart = std::chrono::steady_clock::now();
+    std::vector<unsigned char> data;
+    if (!IoService::instance().readFile(filePath, data)) {
+        if (unreachable != nullptr) *unreachable = true;
+        return cv::Mat();
+    }
+    if (fetchMs != nullptr) {
+        *fetchMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - fetchStart).count();
+    }
+    if (data.empty()) {
+        return cv::Mat();
+    }
+
+    std::string ext = fs::path(filePath).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    cv::Mat img = ext == ".jpg" || ext == ".jpeg" ? loadJpeg(data, head.orientation) : cv::imdecode(data, cv::IMREAD_COLOR);
+
+    // The file is heap, the decoded image comes from the frame pool
+    size_t fileBytes = data.capacity();
+    data = std::vector<unsigned char>();
+    MemoryGovernor::instance().releaseTransient(fileBytes);
+    return img;
+}
+
+cv::Mat DisplayImg::loadJpeg(const std::vector<unsigned char>& data, int orientation)
+{
+    ParallelJpegDecoder decoder(data);
+    cv::Size size = decoder.getImageSize();
+    if (size.width <= 0 || size.height <= 0) {
+        return cv::imdecode(data, cv::IMREAD_COLOR);
+    }
+
+    int flags = reducedDecodeFlag(size.width, size.height, orientation) | cv::IMREAD_IGNORE_ORIENTATION;
+
+    // Very large files with restart markers are decoded in bands on all cores
+    cv::Mat img;
+    bool split = decoder.canSplit() && size.area() >= parallelDecodeMinPixels;
+    if (split) {
+        auto start = std::chrono::steady_clock::now();
+        img = decoder.decode(flags, cv::getNumberOfCPUs());
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        std::cout << "Parallel decode of " << size.width << "x" << size.height << " took " << elapsed.count() << " ms" << std::endl;
+    } else {
+        img = cv::imdecode(data, flags);
+    }
+    // libjpeg's coefficients and the rebuilt bands, which together copy the file
+    MemoryGovernor::instance().releaseTransient(decoder.progressiveBytes() + (split ? data.size() : 0));
+
+    if (!img.empty()) {
+        applyOrientation(img, orientation);
+    }
+    return img;
+}
+
+void DisplayImg::setParallelDecodeMinMegapixels(double value){
+    this->parallelDecodeMinPixels = static_cast<int>(value * 1000000);
+}
+
+cv::Mat DisplayImg::decodeRawPreview(const std::string& filePath, const ImageHead& head)
+{
+    // RAW files are never developed here, show the embedded JPEG instead
+    int width = 0, height = 0;
+    if (!ExifReader::readJpegSize(head.preview, width, height)) {
+        std::cerr << "No usable preview in RAW file: " << filePath << std::endl;
+        return cv::Mat();
+    }
+
+    cv::Mat img = cv::imdecode(head.preview, reducedDecodeFlag(width, height, head.orientation) | cv::IMREAD_IGNORE_ORIENTATION);
+    if (!img.empty()) {
+        applyOrientation(img, head.orientation);
+    }
+    return img;
+}
+
+int DisplayImg::reducedDecodeFlag(int width, int height, int orientation) const
+{
+    // Orientations 5-8 swap width and height once applied
+    if (orientation >= 5) {
+        std::swap(width, height);
+    }
+
+    // Largest JPEG scale that still covers the letterboxed screen area,
+    // zoomed in by the Ken Burns motion
+    double overscan = std::max(1.0, kenBurnsZoom);
+    double fit = std::min(screenWidth * overscan / width, screenHeight * overscan / height);
+    if (fit <= 1.0 / 8) return cv::IMREAD_REDUCED_COLOR_8;
+    if (fit <= 1.0 / 4) return cv::IMREAD_REDUCED_COLOR_4;
+    if (fit <= 1.0 / 2) return cv::IMREAD_REDUCED_COLOR_2;
+    return cv::IMREAD_COLOR;
+}
+
+cv::Mat DisplayImg::loadPreview(const ImageHead& head)
+{
+    if (!head.jpeg || head.preview.empty()) {
+        return cv::Mat();
+    }
 
-    // 2. Text properties
-    int fontFace = cv::FONT_HERSHEY_SIMPLEX;
-    double fontScale = 0.7;  
-    int thickness = 1;       
-    int baseline = 0;
+    // The preview stream has no EXIF of its own, so take the orientation of the main image
+    cv::Mat preview = cv::imdecode(head.preview, cv::IMREAD_COLOR | cv::IMREAD_IGNORE_ORIENTATION);
+    if (!preview.empty()) {
+        applyOrientation(preview, head.orientation);
+    }
+    return preview;
+}
+
+void DisplayImg::applyOrientation(cv::Mat& img, int orientation)
+{
+    switch (orientation) {
+        case 2: cv::flip(img, img, 1); break;
+        case 3: cv::rotate(img, img, cv::ROTATE_180); break;
+        case 4: cv::flip(img, img, 0); break;
+        case 5: cv::transpose(img, img); break;
+        case 6: cv::rotate(img, img, cv::ROTATE_90_CLOCKWISE); break;
+        case 7: cv::transpose(img, img); cv::flip(img, img, -1); break;
+        case 8: cv::rotate(img, img, cv::ROTATE_90_COUNTERCLOCKWISE); break;
+        default: break;
+    }
+}
 
-    // 3. Measure text size
-    cv::Size textSize = cv::getTextSize(countText, fontFace, fontScale, thickness, &baseline);
+cv::Mat DisplayImg::composeFrame(const cv::Mat& img){
+    cv::Mat outputImg;
+    composeFrame(img, outputImg);
+    return outputImg;
+}
 
-    // 4. Random shift generator between -20 and +20
+void DisplayImg::composeFrame(const cv::Mat& img, cv::Mat& frame){
+    if (img.empty()) {
+        frame.release();
+        return;
+    }
+
+    // A frame still shared with the history or the screen is left to them
+    if (frame.u != nullptr && frame.u->refcount > 1) {
+        frame.release();
+    }
+
+    // Resampled straight into the letterbox, no intermediate resized image
+    // and no zero fill of the content area. Portrait panels get the frame
+    // turned into their scanout layout in the same pass.
+    frame.create(renderTarget.size, CV_8UC3);
+    ComposeKernels::letterbox(img, frame, renderTarget.rotation);
+}
+
+cv::Mat DisplayImg::showImage(const SlideFrame& slide){
+    if (slide.frame.empty()) {
+        return cv::Mat();
+    }
+
+    // The slide stays untouched in queue and history, overlays go onto a reused present buffer
+    slide.frame.copyTo(presentFrame);
+    shownSlide = slide;
+
+    // Small random shift of the overlays against burn-in, fixed while the slide is shown
     static std::mt19937 rng(std::random_device{}());
     std::uniform_int_distribution<int> dist(-20, 20);
-    int shiftX = dist(rng);
-    int shiftY = dist(rng);
+    dateShift = cv::Point(dist(rng), dist(rng));
+    countShift = cv::Point(dist(rng), dist(rng));
+
+    drawOverlays(presentFrame, slide);
+    return presentFrame;
+}
+
+void DisplayImg::drawOverlays(cv::Mat& mat, const SlideFrame& slide){
+    if (!textRenderer) {
+        setFontPath(fontPath);
+    }
+
+    if(showDate && !slide.path.empty()){
+        drawUpright(mat, dateBox(slide), [&](cv::Mat& region, cv::Point origin) { writeDate(region, slide, origin); });
+    }
+
+    if(showImgCount){
+        drawUpright(mat, countBox(), [&](cv::Mat& region, cv::Point origin) { showImageCount(region, origin); });
+    }
+}
+
+void DisplayImg::drawUpright(cv::Mat& frame, const cv::Rect& box, const std::function<void(cv::Mat&, cv::Point)>& draw){
+    cv::Rect area = box & cv::Rect(0, 0, screenWidth, screenHeight);
+    if (area.empty()) return;
+
+    if (renderTarget.rotation == 0) {
+        cv::Mat region = frame(area);
+        draw(region, area.tl());
+        return;
+    }
 
-    // 5. Calculate bottom-right position with padding
+    // On a rotated panel only the box is turned upright, drawn on and turned back
+    cv::Rect physical = renderTarget.toPhysical(area);
+    cv::Mat upright, turned;
+    renderTarget.rotateToLogical(frame(physical), upright);
+    draw(upright, area.tl());
+    renderTarget.rotateToPhysical(upright, turned);
+    turned.copyTo(frame(physical));
+}
+
+cv::Mat DisplayImg::renderMotion(double progress){
+    const cv::Mat& source = shownSlide.motionSource;
+    if (source.empty() || isZoomed()) {
+        return cv::Mat();
+    }
+
+    // Eases from the letterbox fit of the still frame into the focus point
+    double t = progress * progress * (3.0 - 2.0 * progress);
+    double fit = std::min(static_cast<double>(screenWidth) / source.cols, static_cast<double>(screenHeight) / source.rows);
+    double scale = fit * (1.0 + (kenBurnsZoom - 1.0) * t);
+
+    // The end view stays inside the image wherever it is smaller than the image,
+    // and then so does every view on the way there
+    double halfWidth = screenWidth / (2.0 * fit * kenBurnsZoom);
+    double halfHeight = screenHeight / (2.0 * fit * kenBurnsZoom);
+    cv::Point2d start(source.cols / 2.0, source.rows / 2.0);
+    cv::Point2d end = start;
+    if (halfWidth < start.x) end.x = std::max(halfWidth, std::min(shownSlide.focus.x, source.cols - halfWidth));
+    if (halfHeight < start.y) end.y = std::max(halfHeight, std::min(shownSlide.focus.y, source.rows - halfHeight));
+    cv::Point2d center = start + (end - start) * t;
+
+    // Screen pixel centers to source pixel centers, rotated panels are written in the same pass
+    cv::Matx23d toSource(1.0 / scale, 0.0, center.x + (0.5 - screenWidth / 2.0) / scale - 0.5,
+                         0.0, 1.0 / scale, center.y + (0.5 - screenHeight / 2.0) / scale - 0.5);
+    presentFrame.create(renderTarget.size, CV_8UC3);
+    ComposeKernels::warpAffine(source, renderTarget.fromPhysical(toSource), presentFrame);
+
+    drawOverlays(presentFrame, shownSlide);
+    return presentFrame;
+}
+
+void DisplayImg::prepareMotion(SlideFrame& slide, const cv::Mat& img){
+    if (kenBurnsZoom <= 1.0 || img.empty()) {
+        return;
+    }
+
+    // Just enough resolution that the end of the zoom is one source pixel per screen pixel
+    double fit = std::min(static_cast<double>(screenWidth) / img.cols, static_cast<double>(screenHeight) / img.rows);
+    double scale = fit * kenBurnsZoom;
+    if (scale < 1.0) {
+        cv::Size size(std::max(1, static_cast<int>(std::lround(img.cols * scale))), std::max(1, static_cast<int>(std::lround(img.rows * scale))));
+        cv::resize(img, slide.motionSource, size, 0, 0, cv::INTER_AREA);
+    } else {
+        slide.motionSource = img;
+    }
+
+    slide.focus = kenBurnsSubjectFocus ? findSubject(slide.motionSource)
+                                       : cv::Point2d(slide.motionSource.cols / 2.0, slide.motionSource.rows / 2.0);
+}
+
+cv::Point2d DisplayImg::findSubject(const cv::Mat& img) const
+{
+    // Peak of the edge energy on a coarse grid: the sharp subject usually has
+    // more detail than a blurred background or the sky
+    double shrink = std::min(1.0, 160.0 / std::max(img.cols, img.rows));
+    cv::Mat small, gray, gradX, gradY, energy;
+    cv::resize(img, small, cv::Size(), shrink, shrink, cv::INTER_AREA);
+    cv::cvtColor(small, gray, cv::COLOR_BGR2GRAY);
+    cv::Sobel(gray, gradX, CV_32F, 1, 0);
+    cv::Sobel(gray, gradY, CV_32F, 0, 1);
+    cv::magnitude(gradX, gradY, energy);
+    cv::GaussianBlur(energy, energy, cv::Size(), std::max(1.0, small.cols / 10.0));
+
+    cv::Point peak;
+    cv::minMaxLoc(energy, nullptr, nullptr, nullptr, &peak);
+    return cv::Point2d((peak.x + 0.5) * img.cols / small.cols, (peak.y + 0.5) * img.rows / small.rows);
+}
+
+cv::Rect DisplayImg::countBox(){
+    // 1. Prepare the text
+    std::string countText = std::to_string(visitedCount.load()) + "/" + std::to_string(imagePaths.size());
+
+    // 2. Measure text size, the line box from the glyph atlas
+    cv::Size textSize = textRenderer->measure(countText, countFontSize);
+
+    // 4. Random shift between -20 and +20, picked when the slide was shown
+    int shiftX = countShift.x;
+    int shiftY = countShift.y;
+
+    // 5. Calculate bottom-right position with padding (top-left of the text box)
     int padding = 10;
-    int x = mat.cols - textSize.width - padding + shiftX;
-    int y = mat.rows - padding + shiftY;
+    int x = screenWidth - textSize.width - padding + shiftX;
+    int y = screenHeight - textSize.height - padding + shiftY;
 
     // 6. Clamp to stay inside visible area
-    x = std::max(padding, std::min(x, mat.cols - textSize.width - padding));
-    y = std::max(textSize.height + padding, std::min(y, mat.rows - padding));
+    x = std::max(padding, std::min(x, screenWidth - textSize.width - padding));
+    y = std::max(padding, std::min(y, screenHeight - textSize.height - padding));
+
+    // Background box around the text, in upright screen coordinates
+    return cv::Rect(x - 5, y - 5, textSize.width + 11, textSize.height + 11);
+}
+
+void DisplayImg::showImageCount(cv::Mat& mat, cv::Point origin){
+    if (mat.empty()) return; // Safety check
+
+    std::string countText = std::to_string(visitedCount.load()) + "/" + std::to_string(imagePaths.size());
+    cv::Rect box = countBox() - origin;
 
     // 7. Draw a black transparent background (optional)
-    cv::rectangle(mat,
-                  cv::Point(x - 5, y - textSize.height - 5),
-                  cv::Point(x + textSize.width + 5, y + 5),
-                  cv::Scalar(0, 0, 0, 150), // Black, semi-transparent
-                  cv::FILLED);
+    cv::rectangle(mat, box, cv::Scalar(0, 0, 0, 150), cv::FILLED); // Black, semi-transparent
 
     // 8. Draw the text in white
-    cv::putText(mat, countText, cv::Point(x, y), fontFace, fontScale, cv::Scalar(255, 255, 255), thickness, cv::LINE_AA);
+    textRenderer->draw(mat, countText, countFontSize, box.tl() + cv::Point(5, 5), cv::Scalar(255, 255, 255));
 }
 
 void DisplayImg::setShowImgCount(bool value){
     this->showImgCount = value;
 }
 
-void DisplayImg::writeDate(cv::Mat& mat, std::string filePath)
+cv::Rect DisplayImg::dateBox(const SlideFrame& slide)
 {
-    if (mat.empty() || filePath.empty()) return;
+    // --- Small random shift, picked when the slide was shown ---
+    int shiftX = dateShift.x;
+    int shiftY = dateShift.y;
 
-    std::string dateText = "Unknown date";
+    int baseX = 30;
+    int baseY = 30;
 
-    try
-    {
-        Exiv2::Image::AutoPtr image = Exiv2::ImageFactory::open(filePath);
-        if (image.get() != nullptr)
-        {
-            image->readMetadata();
-            Exiv2::ExifData& exifData = image->exifData();
+    // Top-left of the first text line
+    int posX = std::max(5, baseX + shiftX);
+    int posY = std::max(10, baseY + shiftY);
+
+    // --- Measure text sizes (cached per text, no rasterizing) ---
+    cv::Size dateSize = textRenderer->measure(slide.dateText, dateFontSize);
+    cv::Size folderSize = textRenderer->measure(slide.folderName, dateFontSize);
+
+    // Calculate the width of the larger text
+    int fullWidth = std::max(dateSize.width, folderSize.width);
+    int fullHeight = dateSize.height + folderSize.height; // line boxes include the spacing
+
+    // --- Background rectangle, in upright screen coordinates ---
+    return cv::Rect(posX - 5, posY - 5, fullWidth + 10, fullHeight + 10);
+}
+
+void DisplayImg::writeDate(cv::Mat& mat, const SlideFrame& slide, cv::Point origin)
+{
+    if (mat.empty() || slide.path.empty()) return;
+
+    cv::Scalar textColor(255, 255, 255);
+    cv::Rect box = dateBox(slide);
+    cv::Point pos = box.tl() + cv::Point(5, 5) - origin;
+    cv::Size dateSize = textRenderer->measure(slide.dateText, dateFontSize);
+
+    // --- Draw semi-transparent black rounded background ---
+    int cornerRadius = 10;
+    cv::Rect backgroundRect = (box & cv::Rect(0, 0, screenWidth, screenHeight)) - origin;
+    drawRoundedRectangle(mat, backgroundRect, cv::Scalar(0, 0, 0), cornerRadius, 0.5);
 
-            if (!exifData.empty())
+    // --- Draw the texts, UTF-8 folder names are drawn as they are ---
+    textRenderer->draw(mat, slide.dateText, dateFontSize, pos, textColor);
+    if(showFldrName){
+        textRenderer->draw(mat, slide.folderName, dateFontSize, pos + cv::Point(0, dateSize.height), textColor);
+    }
+
+}
+
+ImageHead DisplayImg::readHead(const std::string& filePath, bool raw, bool wantPreview)
+{
+    ImageHead head;
+
+    // Fast path: parse APP1 / the TIFF header directly
+    ExifReader exif(filePath);
+    head.jpeg = exif.isJpeg();
+    head.orientation = exif.getOrientation();
+    if (exif.hasExif()) {
+        head.rawDate = exif.getDateTimeOriginal();
+        if (head.rawDate.empty()) {
+            head.rawDate = exif.getDateTime();
+        }
+    }
+    if (raw || (wantPreview && head.jpeg)) {
+        exif.readPreview(head.preview);
+    }
+
+    // Fall back to Exiv2 for containers the light reader does not understand
+    int width = 0, height = 0;
+    bool needDate = head.rawDate.empty() && !head.jpeg;
+    bool needPreview = raw && !ExifReader::readJpegSize(head.preview, width, height);
+    size_t exivBytes = 0;
+    if (needDate || needPreview) {
+        try
+        {
+            Exiv2::Image::AutoPtr image = Exiv2::ImageFactory::open(filePath);
+            if (image.get() != nullptr)
             {
-                auto pos = exifData.findKey(Exiv2::ExifKey("Exif.Photo.DateTimeOriginal"));
-                if (pos == exifData.end()) {
-                    pos = exifData.findKey(Exiv2::ExifKey("Exif.Image.DateTime"));
-                }
-                if (pos != exifData.end())
+                image->readMetadata();
+                Exiv2::ExifData& exifData = image->exifData();
+
+                if (needDate && !exifData.empty())
                 {
-                    dateText = pos->toString();
-
-                    // Format date into DD.MM.YYYY
-                    std::istringstream iss(dateText);
-                    std::tm tm = {};
-                    iss >> std::get_time(&tm, "%Y:%m:%d %H:%M:%S");
-
-                    if (!iss.fail()) {
-                        std::ostringstream formattedDate;
-                        formattedDate << std::setw(2) << std::setfill('0') << tm.tm_mday << "."
-                                      << std::setw(2) << std::setfill('0') << (tm.tm_mon + 1) << "."
-                                      << (tm.tm_year + 1900);
-                        dateText = formattedDate.str();
+                    auto pos = exifData.findKey(Exiv2::ExifKey("Exif.Photo.DateTimeOriginal"));
+                    if (pos == exifData.end()) {
+                        pos = exifData.findKey(Exiv2::ExifKey("Exif.Image.DateTime"));
                     }
-                    else {
-                        dateText = "Unknown date";
+                    if (pos != exifData.end())
+                    {
+                        head.rawDate = pos->toString();
+                    }
+                }
+
+                // The list is sorted by size, the last entry is the largest preview
+                if (needPreview)
+                {
+                    Exiv2::PreviewManager previewManager(*image);
+                    Exiv2::PreviewPropertiesList previews = previewManager.getPreviewProperties();
+                    if (!previews.empty())
+                    {
+                        Exiv2::PreviewImage preview = previewManager.getPreviewImage(previews.back());
+                        head.preview.assign(preview.pData(), preview.pData() + preview.size());
+                        exivBytes = preview.size();
                     }
                 }
             }
         }
+        catch (const Exiv2::Error& e)
+        {
+            std::cerr << "EXIF read error: " << e.what() << std::endl;
+        }
     }
-    catch (const Exiv2::Error& e)
-    {
-        std::cerr << "EXIF read error: " << e.what() << std::endl;
+    if (exivBytes > 0) {
+        MemoryGovernor::instance().releaseTransient(exivBytes);
     }
+    return head;
+}
 
-    // --- Now extract the folder name ---
-    std::string folderName;
+bool DisplayImg::fetchHead(const std::string& filePath, bool wantPreview, ImageHead& head)
+{
+    bool raw = isRawFile(filePath);
+    return IoService::instance().call<ImageHead>("header of " + filePath, [filePath, raw, wantPreview]() {
+        return readHead(filePath, raw, wantPreview);
+    }, head);
+}
+
+std::string DisplayImg::formatCaptureDate(const std::string& rawDate)
+{
+    std::string dateText = "Unknown date";
+
+    if (!rawDate.empty())
     {
-        std::filesystem::path path(filePath);
-        folderName = path.parent_path().filename().string();
+        // Format date into DD.MM.YYYY
+        std::istringstream iss(rawDate);
+        std::tm tm = {};
+        iss >> std::get_time(&tm, "%Y:%m:%d %H:%M:%S");
+
+        if (!iss.fail()) {
+            std::ostringstream formattedDate;
+            formattedDate << std::setw(2) << std::setfill('0') << tm.tm_mday << "."
+                          << std::setw(2) << std::setfill('0') << (tm.tm_mon + 1) << "."
+                          << (tm.tm_year + 1900);
+            dateText = formattedDate.str();
+        }
     }
 
-    folderName = replaceUmlauts(folderName);
-
-    // --- Small random shift ---
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dis(-20, 20);
+    return dateText;
+}
 
-    int shiftX = dis(gen);
-    int shiftY = dis(gen);
+void DisplayImg::setShowFolderName(bool value){
+    this->showFldrName = value;
+}
 
-    int baseX = 30;
-    int baseY = 50;
+void DisplayImg::setZoomMemoryBudget(size_t bytes){
+    this->zoomMemoryBudget = bytes;
+}
 
-    int posX = std::max(0, baseX + shiftX);
-    int posY = std::max(30, baseY + shiftY);
+void DisplayImg::setRenderTarget(const RenderTarget& target){
+    this->renderTarget = target;
+    this->screenWidth = target.logicalSize().width;
+    this->screenHeight = target.logicalSize().height;
+}
 
-    // --- Font settings ---
-    int fontFace = cv::FONT_HERSHEY_SIMPLEX;
-    double fontScale = 0.8;
-    int thickness = 1;
-    cv::Scalar textColor(255, 255, 255);
+void DisplayImg::setKenBurnsZoom(double value){
+    this->kenBurnsZoom = value;
+}
 
-    // --- Measure text sizes ---
-    int baseline1 = 0, baseline2 = 0;
-    cv::Size dateSize = cv::getTextSize(dateText, fontFace, fontScale, thickness, &baseline1);
-    cv::Size folderSize = cv::getTextSize(folderName, fontFace, fontScale, thickness, &baseline2);
+void DisplayImg::setSwitchLead(int ms){
+    this->switchLead = std::chrono::milliseconds(std::max(0, ms));
+}
 
-    // Calculate the width of the larger text
-    int fullWidth = std::max(dateSize.width, folderSize.width);
-    int fullHeight = dateSize.height + folderSize.height + 10; // 10px gap between lines
+void DisplayImg::setPrefetchDepth(int minDepth, int maxDepth, size_t budgetBytes){
+    prefetch.configure(minDepth, std::min(maxDepth, static_cast<int>(maxBufferSize)), budgetBytes);
+}
 
-    // --- Background rectangle ---
-    cv::Rect backgroundRect(posX - 5, posY - dateSize.height - 5, fullWidth + 10, fullHeight + 10);
-    backgroundRect &= cv::Rect(0, 0, mat.cols, mat.rows);
+void DisplayImg::addMemoryHolders(MemoryGovernor& governor){
+    // Zoom and history are UI thread state like the governor's update
+    governor.addHolder("zoom", [this]() {
+        return zoomCache.total() * zoomCache.elemSize() + (zoomDecoder ? zoomDecoder->residentBytes() : 0);
+    }, [this](size_t bytes) {
+        // The decoder's part stays while zoomed, only the cached region can go
+        size_t resident = zoomDecoder ? zoomDecoder->residentBytes() : 0;
+        zoomMemoryLimit = bytes > resident ? bytes - resident : 0;
+        if (zoomCache.total() * zoomCache.elemSize() > zoomMemoryLimit) {
+            // The next pan decodes a smaller region
+            zoomCache = cv::Mat();
+            zoomCacheDenom = 0;
+        }
+    });
+    governor.addHolder("history", [this]() {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        size_t bytes = 0;
+        for (const auto& entry : historyFrames) {
+            bytes += slideBytes(entry.second);
+        }
+        return bytes;
+    }, [this](size_t bytes) {
+        historyMemoryLimit = bytes;
+        prefetchHistory();
+    });
+    governor.addHolder("queue", [this]() {
+        return queuedBytes.load();
+    }, [this](size_t bytes) {
+        prefetch.setMemoryLimit(bytes);
+    });
+}
 
-    // --- Draw semi-transparent black rounded background ---
-    cv::Mat roi = mat(backgroundRect);
-    cv::Mat overlay;
-    roi.copyTo(overlay);
+size_t DisplayImg::screenBytes() const
+{
+    // The shown still is in the history, its motion source is not
+    return presentFrame.total() * presentFrame.elemSize() + currentImg.motionSource.total() * currentImg.motionSource.elemSize();
+}
 
-    int cornerRadius = 10;
-    drawRoundedRectangle(mat, backgroundRect, cv::Scalar(0, 0, 0), cornerRadius, 0.5);
+void DisplayImg::setWakeup(std::function<void()> wakeup){
+    this->wakeup = std::move(wakeup);
+}
 
-    double alpha = 0.5;
-    cv::addWeighted(overlay, alpha, roi, 1.0 - alpha, 0, roi);
+void DisplayImg::setSwitchDeadline(std::chrono::steady_clock::time_point deadline)
+{
+    switchDeadline = deadline.time_since_epoch().count();
+    deadlineLate = false;
+}
 
-    // --- Draw the texts ---
-    int lineSpacing = 5; // space between lines
+void DisplayImg::checkSwitchDeadline()
+{
+    if (deadlineLate || !readyFrames.empty()) return;
+
+    std::chrono::steady_clock::time_point deadline{std::chrono::steady_clock::duration(switchDeadline.load())};
+    auto now = std::chrono::steady_clock::now();
+    if (deadline.time_since_epoch().count() == 0 || now + switchLead < deadline) return;
+
+    deadlineLate = true;
+    lateDeadlines++;
+    std::cout << "Next slide not ready " << std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count()
+              << " ms before its switch, preparing it as interactive work (" << lateDeadlines << " times)" << std::endl;
+    // Raises a preparation already queued or running
+    schedulePreload();
+}
 
-    cv::putText(mat, dateText, cv::Point(posX, posY), fontFace, fontScale, textColor, thickness, cv::LINE_AA);
-    if(showFldrName){
-        cv::putText(mat, folderName, cv::Point(posX, posY + dateSize.height + lineSpacing), fontFace, fontScale, textColor, thickness, cv::LINE_AA);
-    }
+void DisplayImg::setKenBurnsFocus(const std::string& value){
+    this->kenBurnsSubjectFocus = value != "center";
+}
 
+void DisplayImg::setFontPath(const std::string& path){
+    this->fontPath = path;
+    textRenderer = std::make_unique<TextRenderer>(path);
+    textRenderer->preload(dateFontSize);
+    textRenderer->preload(countFontSize);
 }
 
-void DisplayImg::setShowFolderName(bool value){
-    this->showFldrName = value;
+bool DisplayImg::isZoomed() const {
+    return zoomScale > 0.0;
 }
 
-void DisplayImg::drawRoundedRectangle(cv::Mat& img, const cv::Rect& rect, const cv::Scalar& color, int radius, double alpha)
+cv::Mat DisplayImg::zoomAt(int x, int y, double factor)
 {
-    cv::Mat roi = img(rect);
+    if (currentImg.frame.empty()) {
+        return cv::Mat();
+    }
+
+    if (!isZoomed()) {
+        // Only the reads go through the I/O service, the UI waits for them at
+        // most zoomIoTimeout. A slow decode is no sign of a slow source.
+        std::string filePath = currentImg.path;
+        int orientation = 1;
+        std::vector<unsigned char> data;
+        if (!IoService::instance().call<int>("orientation of " + filePath, [filePath]() {
+                return ExifReader(filePath).getOrientation();
+            }, orientation, zoomIoTimeout)
+            || !IoService::instance().readFile(filePath, data, zoomIoTimeout)) {
+            return cv::Mat();
+        }
+        zoomDecoder = std::make_unique<RegionDecoder>(std::move(data), zoomMemoryBudget);
+        if (!zoomDecoder->isOpen()) {
+            zoomDecoder.reset();
+            return cv::Mat();
+        }
+
+        zoomOrientation = orientation;
+        zoomImageSize = zoomDecoder->getImageSize();
+        if (zoomOrientation >= 5) {
+            std::swap(zoomImageSize.width, zoomImageSize.height);
+        }
+        zoomCache = cv::Mat();
+        zoomCacheDenom = 0;
+    }
 
-    // Create overlay for transparency
-    cv::Mat overlay;
-    roi.copyTo(overlay);
+    double fit = std::min(static_cast<double>(screenWidth) / zoomImageSize.width, static_cast<double>(screenHeight) / zoomImageSize.height);
+    double fill = std::max(static_cast<double>(screenWidth) / zoomImageSize.width, static_cast<double>(screenHeight) / zoomImageSize.height);
+    double current = isZoomed() ? zoomScale : fit;
 
-    // Create black background
-    overlay.setTo(cv::Scalar(0, 0, 0));
+    // Image point under the finger
+    cv::Point2d anchor;
+    if (isZoomed()) {
+        anchor = zoomCenter + cv::Point2d((x - screenWidth / 2.0) / current, (y - screenHeight / 2.0) / current);
+    } else {
+        anchor = cv::Point2d((x - (screenWidth - zoomImageSize.width * fit) / 2.0) / fit,
+                             (y - (screenHeight - zoomImageSize.height * fit) / 2.0) / fit);
+    }
 
-    // Create a mask for rounded rectangle
-    cv::Mat mask = cv::Mat::zeros(rect.height, rect.width, CV_8UC1);
-    cv::rectangle(mask, cv::Rect(radius, 0, mask.cols - 2 * radius, mask.rows), 255, cv::FILLED);
-    cv::rectangle(mask, cv::Rect(0, radius, mask.cols, mask.rows - 2 * radius), 255, cv::FILLED);
+    // Panoramas first zoom to fill the screen, never beyond native resolution
+    double target = current * factor;
+    if (!isZoomed() && factor > 1.0) {
+        target = std::max(target, fill);
+    }
+    target = std::min(target, std::max(1.0, fit));
 
-    cv::circle(mask, cv::Point(radius, radius), radius, 255, cv::FILLED);
-    cv::circle(mask, cv::Point(mask.cols - radius, radius), radius, 255, cv::FILLED);
-    cv::circle(mask, cv::Point(radius, mask.rows - radius), radius, 255, cv::FILLED);
-    cv::circle(mask, cv::Point(mask.cols - radius, mask.rows - radius), radius, 255, cv::FILLED);
+    if (target <= fit * 1.01) {
+        return resetZoom();
+    }
 
-    // Apply mask to overlay
-    overlay.copyTo(roi, mask);
+    zoomScale = target;
+    zoomCenter = anchor - cv::Point2d((x - screenWidth / 2.0) / zoomScale, (y - screenHeight / 2.0) / zoomScale);
+    std::cout << "Zoom: " << zoomScale << " px/px" << std::endl;
+    return renderZoom();
+}
 
-    // Blend overlay and original roi
-    cv::addWeighted(overlay, alpha, img(rect), 1.0 - alpha, 0, img(rect));
+cv::Mat DisplayImg::panZoom(int dx, int dy)
+{
+    if (!isZoomed()) return cv::Mat();
+    zoomCenter -= cv::Point2d(dx / zoomScale, dy / zoomScale);
+    return renderZoom();
 }
 
-std::string DisplayImg::replaceUmlauts(const std::string& input) {
-    std::string output;
-    for (size_t i = 0; i < input.size(); ++i) {
-        unsigned char c = input[i];
+void DisplayImg::clearZoom()
+{
+    zoomScale = 0.0;
+    zoomDecoder.reset();
+    zoomCache = cv::Mat();
+    zoomCacheDenom = 0;
+}
 
-        // Handle UTF-8 umlauts (ä=0xC3 0xA4, ö=0xC3 0xB6, ü=0xC3 0xBC)
-        if (c == 0xC3 && i + 1 < input.size()) {
-            unsigned char next = input[i + 1];
-            switch (next) {
-                case 0xA4: output += "ae"; i++; continue; // ä
-                case 0xB6: output += "oe"; i++; continue; // ö
-                case 0xBC: output += "ue"; i++; continue; // ü
-                case 0x84: output += "Ae"; i++; continue; // Ä
-                case 0x96: output += "Oe"; i++; continue; // Ö
-                case 0x9C: output += "Ue"; i++; continue; // Ü
-                case 0x9F: output += "ss"; i++; continue; // ß
-            }
+cv::Mat DisplayImg::resetZoom()
+{
+    clearZoom();
+
+    if (currentImg.frame.empty()) {
+        return cv::Mat();
+    }
+    return showImage(currentImg);
+}
+
+cv::Rect DisplayImg::toStoredRect(const cv::Rect& rect) const
+{
+    // Inverse of applyOrientation for a rectangle in displayed coordinates
+    int storedWidth = zoomOrientation >= 5 ? zoomImageSize.height : zoomImageSize.width;
+    int storedHeight = zoomOrientation >= 5 ? zoomImageSize.width : zoomImageSize.height;
+    int x0 = rect.x, y0 = rect.y, x1 = rect.x + rect.width, y1 = rect.y + rect.height;
+
+    switch (zoomOrientation) {
+        case 2: return cv::Rect(storedWidth - x1, y0, rect.width, rect.height);
+        case 3: return cv::Rect(storedWidth - x1, storedHeight - y1, rect.width, rect.height);
+        case 4: return cv::Rect(x0, storedHeight - y1, rect.width, rect.height);
+        case 5: return cv::Rect(y0, x0, rect.height, rect.width);
+        case 6: return cv::Rect(y0, storedHeight - x1, rect.height, rect.width);
+        case 7: return cv::Rect(storedWidth - y1, storedHeight - x1, rect.height, rect.width);
+        case 8: return cv::Rect(storedWidth - y1, x0, rect.height, rect.width);
+        default: return rect;
+    }
+}
+
+cv::Mat DisplayImg::renderZoom()
+{
+    cv::Rect bounds(0, 0, zoomImageSize.width, zoomImageSize.height);
+
+    // Viewport in full resolution image coordinates, kept inside the image
+    double viewWidth = std::min(screenWidth / zoomScale, static_cast<double>(zoomImageSize.width));
+    double viewHeight = std::min(screenHeight / zoomScale, static_cast<double>(zoomImageSize.height));
+    zoomCenter.x = std::max(viewWidth / 2, std::min(zoomCenter.x, zoomImageSize.width - viewWidth / 2));
+    zoomCenter.y = std::max(viewHeight / 2, std::min(zoomCenter.y, zoomImageSize.height - viewHeight / 2));
+    cv::Rect view(static_cast<int>(zoomCenter.x - viewWidth / 2), static_cast<int>(zoomCenter.y - viewHeight / 2),
+                  static_cast<int>(viewWidth), static_cast<int>(viewHeight));
+    view &= bounds;
+
+    int denom = RegionDecoder::scaleDenomFor(zoomScale);
+    bool cached = !zoomCache.empty() && zoomCacheDenom == denom && (zoomCachedRegion & view) == view;
+
+    if (!cached) {
+        // Decode as much around the viewport as the budget allows so panning stays smooth
+        cv::Rect candidates[] = {
+            bounds,
+            cv::Rect(view.x - view.width, view.y - view.height, view.width * 3, view.height * 3) & bounds,
+            cv::Rect(view.x - view.width / 2, view.y - view.height / 2, view.width * 2, view.height * 2) & bounds,
+            view
+        };
+        for (const cv::Rect& region : candidates) {
+            size_t bytes = static_cast<size_t>(region.width / denom + 1) * (region.height / denom + 1) * 3;
+            if (bytes > zoomMemoryBudget || (bytes > zoomMemoryLimit && region != view)) continue;
+
+            zoomCache = cv::Mat(); // release the old region before decoding the new one
+            cv::Mat decoded = zoomDecoder->decodeRegion(toStoredRect(region), denom);
+            if (decoded.empty()) break;
+
+            applyOrientation(decoded, zoomOrientation);
+            zoomCache = decoded;
+            zoomCachedRegion = region;
+            zoomCacheDenom = denom;
+            break;
+        }
+        if (zoomCache.empty()) {
+            return cv::Mat();
         }
+    }
+
+    double cacheScaleX = static_cast<double>(zoomCache.cols) / zoomCachedRegion.width;
+    double cacheScaleY = static_cast<double>(zoomCache.rows) / zoomCachedRegion.height;
+    cv::Rect source(static_cast<int>((view.x - zoomCachedRegion.x) * cacheScaleX), static_cast<int>((view.y - zoomCachedRegion.y) * cacheScaleY),
+                    std::max(1, static_cast<int>(view.width * cacheScaleX)), std::max(1, static_cast<int>(view.height * cacheScaleY)));
+    source &= cv::Rect(0, 0, zoomCache.cols, zoomCache.rows);
+
+    int outWidth = std::min(screenWidth, static_cast<int>(view.width * zoomScale));
+    int outHeight = std::min(screenHeight, static_cast<int>(view.height * zoomScale));
+    cv::Rect output((screenWidth - outWidth) / 2, (screenHeight - outHeight) / 2, outWidth, outHeight);
+
+    // Bilinear like cv::resize, straight into the scanout layout. Where the
+    // output does not fill the screen the view spans the whole cache, so
+    // everything around it maps outside the cache and stays black.
+    double stepX = static_cast<double>(source.width) / outWidth;
+    double stepY = static_cast<double>(source.height) / outHeight;
+    cv::Matx23d toCache(stepX, 0.0, source.x + (0.5 - output.x) * stepX - 0.5,
+                        0.0, stepY, source.y + (0.5 - output.y) * stepY - 0.5);
+    cv::Mat outputImg(renderTarget.size, CV_8UC3);
+    ComposeKernels::warpAffine(zoomCache, renderTarget.fromPhysical(toCache), outputImg);
+    return outputImg;
+}
 
-        output += c; // Default: copy byte
+void DisplayImg::drawRoundedRectangle(cv::Mat& img, const cv::Rect& rect, const cv::Scalar& color, int radius, double alpha)
+{
+    if (rect.empty()) return;
+
+    // Masks are built once per box size, the text widths repeat a lot
+    std::tuple<int, int, int> key(rect.width, rect.height, radius);
+    auto it = roundedMasks.find(key);
+    if (it == roundedMasks.end()) {
+        if (roundedMasks.size() >= maxRoundedMasks) {
+            roundedMasks.clear();
+        }
+        it = roundedMasks.emplace(key, ComposeKernels::roundedRectMask(rect.size(), radius)).first;
     }
-    return output;
+
+    // One pass over the box, no overlay copy and no second blend
+    ComposeKernels::blendMask(img, it->second, rect.tl(), color, alpha);
 }
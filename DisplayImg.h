@@ -2,7 +2,7 @@
 
 #include <string>
 #include <vector>
-#include <queue>
+#include <atomic>
 #include <deque>
 #include <mutex>
 #include <condition_variable>
@@ -17,6 +17,45 @@
 #include <iomanip>
 #include <sstream>
 #include "json.hpp"
+#include "ExifReader.h"
+#include "RegionDecoder.h"
+#include "ParallelJpegDecoder.h"
+#include "ComposeKernels.h"
+#include "TextRenderer.h"
+#include "RenderTarget.h"
+#include "FrameRing.h"
+#include "Executor.h"
+#include "PrefetchController.h"
+#include "IoService.h"
+#include "MemoryGovernor.h"
+#include <functional>
+#include <memory>
+#include <map>
+#include <tuple>
+#include <limits>
+// A slide as it is kept in the queue and the history: the letterboxed
+// screen resolution frame without overlays, plus the overlay texts.
+// Queued slides also carry the source for the pan and zoom animation and
+// the point it moves to, the history keeps stills only.
+struct SlideFrame {
+    std::string path;
+    cv::Mat frame;
+    std::string dateText;
+    std::string folderName;
+    cv::Mat motionSource;
+    cv::Point2d focus;
+};
+
+// Read from an image before the full file: capture date, orientation and
+// the embedded preview (of JPEGs on request, of RAW files always, they are
+// shown from it)
+struct ImageHead {
+    bool jpeg = false;
+    int orientation = 1;
+    std::string rawDate; // "YYYY:MM:DD HH:MM:SS" or empty
+    std::vector<unsigned char> preview;
+};
+
 class DisplayImg {
 public:
     DisplayImg();
@@ -24,9 +63,18 @@ public:
 
 
     std::vector<std::string> findImages();
-    void startPreloading();
-    cv::Mat getNextImage();
+    // Slides are prepared and db.json is written on the executor's workers
+    void startPreloading(Executor& executor);
+    // Never blocks: empty when nothing is ready yet, the request then stays
+    // open (isWaitingForNext) until resumeNextImage() or cancelNextImage().
+    // getPrevImage() too, for a history entry that was not prefetched.
+    cv::Mat getNextImage(bool userInitiated = false);
+    bool isWaitingForNext() const;
+    bool isNextReady();
+    cv::Mat resumeNextImage();
+    void cancelNextImage();
     cv::Mat getPrevImage();
+    bool refineCurrentImage(cv::Mat& img);
 
     void resetVisitedPathsIfNeeded();
 
@@ -34,41 +82,262 @@ public:
     void setShowDate(bool value);
     void setShowImgCount(bool value);
     void setShowFolderName(bool value);
+    void setZoomMemoryBudget(size_t bytes);
+    void setParallelDecodeMinMegapixels(double value);
+    void setFontPath(const std::string& path);
+    void setKenBurnsZoom(double value);
+    void setKenBurnsFocus(const std::string& value);
+    // How long before a switch the next slide should be ready
+    void setSwitchLead(int ms);
+    // Slides prepared ahead adapt between min and max (at most maxBufferSize)
+    // to the measured preparation times and tap rate, within budgetBytes
+    void setPrefetchDepth(int minDepth, int maxDepth, size_t budgetBytes);
+    // The zoom cache, the history frames and the queued slides, shed in that
+    // order. The governor must not update once this object is gone.
+    void addMemoryHolders(MemoryGovernor& governor);
+    // Screen frame and motion source of the slide on screen, UI thread
+    size_t screenBytes() const;
+
+    // The next planned slide switch. checkSwitchDeadline(), called from the
+    // main loop, escalates the preparation once the deadline is closer than
+    // the lead time and the ring is still empty.
+    void setSwitchDeadline(std::chrono::steady_clock::time_point deadline);
+    void checkSwitchDeadline();
+
+    // With nothing to prepare the preparation task stops instead of
+    // sleeping on a worker. The main loop calls checkPreloadRetry() once
+    // preloadRetryTime() has passed; at max only a taken slide restarts it.
+    std::chrono::steady_clock::time_point preloadRetryTime() const;
+    void checkPreloadRetry();
+
+    // Called from the worker threads whenever the UI may find something new:
+    // a slide or preview ready, a decode the UI waits on finished. Set
+    // before preloading starts.
+    void setWakeup(std::function<void()> wakeup);
+
+    // Frames are composed for this target, set before preloading starts
+    void setRenderTarget(const RenderTarget& target);
+
+    // Pan and zoom frame of the slide on screen for progress 0..1, with the
+    // overlays at the same place as on the still. Empty without a motion source.
+    cv::Mat renderMotion(double progress);
+
+    // Zoom and pan on the current image, coordinates are screen pixels
+    bool isZoomed() const;
+    cv::Mat zoomAt(int x, int y, double factor);
+    cv::Mat panZoom(int dx, int dy);
+    cv::Mat resetZoom();
 private:
-    std::string replaceUmlauts(const std::string& input);
-    void preloadThreadFunc();
+    void submit(Executor::Priority priority, std::function<void()> task, Executor::CancelToken token = Executor::CancelToken());
+    void schedulePreload();
+    void prepareNextSlide();
+    void idlePreload(std::chrono::steady_clock::time_point retryAt);
+    void resetVisitedPaths();
     void loadVisitedPathsFromJson();
     void saveVisitedPathToJson(const std::string& newPath);
-    void writeDate(cv::Mat& mat, std::string filePath);
+    void scheduleDbWrite();
+    void writeVisitedPaths();
+    cv::Mat takeNextImage(bool userInitiated);
+    void endStall(const char* outcome);
+    void addToHistory(const SlideFrame& slide);
+    cv::Mat showHistoryEntry(int position, int direction);
+    cv::Mat resumeHistoryEntry();
+    // unreachable is set when the source did not answer, the entry itself may be fine
+    SlideFrame loadHistorySlide(const std::string& path, const Executor::CancelToken& token, bool* unreachable = nullptr);
+    void publishCachedSlide(SlideFrame& slot);
+    void noteNavigation(int direction);
+    void prefetchHistory();
+    void writeDate(cv::Mat& mat, const SlideFrame& slide, cv::Point origin);
+    cv::Rect dateBox(const SlideFrame& slide);
+    // Runs on an I/O thread, it must not touch the object
+    static ImageHead readHead(const std::string& filePath, bool raw, bool wantPreview);
+    bool fetchHead(const std::string& filePath, bool wantPreview, ImageHead& head);
+    std::string formatCaptureDate(const std::string& rawDate);
     //void showFolderName(cv::Mat& mat, std::string filePath);
     void drawRoundedRectangle(cv::Mat& img, const cv::Rect& rect, const cv::Scalar& color, int radius, double alpha);
-    void showImageCount(cv::Mat& mat);
-    cv::Mat showImage(std::pair<std::string, cv::Mat> pair);
+    void showImageCount(cv::Mat& mat, cv::Point origin);
+    cv::Rect countBox();
+    void drawOverlays(cv::Mat& mat, const SlideFrame& slide);
+    void drawUpright(cv::Mat& frame, const cv::Rect& box, const std::function<void(cv::Mat&, cv::Point)>& draw);
+    void prepareMotion(SlideFrame& slide, const cv::Mat& img);
+    cv::Point2d findSubject(const cv::Mat& img) const;
+    cv::Mat composeFrame(const cv::Mat& img);
+    void composeFrame(const cv::Mat& img, cv::Mat& frame);
+    cv::Mat showImage(const SlideFrame& slide);
+    cv::Mat loadPreview(const ImageHead& head);
+    // fetchMs gets the time spent reading the file, RAW files have
+    // everything in the head already. unreachable as in loadHistorySlide.
+    cv::Mat loadImage(const std::string& filePath, const ImageHead& head, double* fetchMs = nullptr, bool* unreachable = nullptr);
+    cv::Mat decodeRawPreview(const std::string& filePath, const ImageHead& head);
+    cv::Mat loadJpeg(const std::vector<unsigned char>& data, int orientation);
+    int reducedDecodeFlag(int width, int height, int orientation) const;
+    bool isRawFile(const std::string& filePath) const;
+    void removeRawDuplicates();
+    cv::Mat renderZoom();
+    void clearZoom();
+    cv::Rect toStoredRect(const cv::Rect& rect) const;
+    void applyOrientation(cv::Mat& img, int orientation);
     std::string folderPath = "/mnt/paulNAS/";
     std::vector<std::string> folderFilter;
+    const std::vector<std::string> rawExtensions = { ".cr2", ".nef", ".arw", ".dng" };
+
+    // JPEGs from this size on are decoded in parallel bands when possible
+    int parallelDecodeMinPixels = 16 * 1000000;
 
+    // Upright screen size, frames are rendered for renderTarget
+    RenderTarget renderTarget;
+    int screenWidth = 1920;
+    int screenHeight = 1200;
+
+    // Paths waiting for the next db.json write, guarded by visitedPathsMutex.
+    // dbFileMutex keeps the writes in order.
     std::mutex visitedPathsMutex;
+    std::mutex dbFileMutex;
+    std::vector<std::string> dbAppends;
+    std::vector<std::string> dbHistoryAppends;
+    bool dbReset = false;
+    bool dbWriteScheduled = false;
     const std::string dbFilePath = "db.json";
 
     std::vector<std::string> imagePaths;
+    // Only the preparation task touches visitedPaths, the UI reads the count
     std::unordered_set<std::string> visitedPaths;
-    std::queue<std::pair<std::string, cv::Mat>> imageQueue;
-    std::deque<std::pair<std::string, cv::Mat>> pastImages;
+    std::atomic<size_t> visitedCount{0};
+
+    // Every slide that came from the ring, oldest first. Kept in db.json, so
+    // stepping back also reaches slides of earlier runs. historyPosition is
+    // the entry on screen.
+    std::vector<std::string> history;
+    int historyPosition = -1;
+    const size_t maxHistory = 2000;
 
-    std::mutex queueMutex;
-    std::condition_variable queueCondVar;
-    std::thread preloadThread;
-    bool stopThread;
+    // Screen frames of history entries, guarded by historyMutex: the most
+    // recent ones and those prefetched around historyPosition. historyLoads
+    // holds the tokens of prefetches that are queued or running.
+    std::mutex historyMutex;
+    std::map<std::string, SlideFrame> historyFrames;
+    std::map<std::string, Executor::CancelToken> historyLoads;
+    // Entry the UI waits on when it was not prefetched, loaded as interactive
+    // work and picked up by resumeNextImage(). Guarded by historyMutex.
+    struct HistoryWait {
+        std::string path;
+        int position = -1;
+        int direction = 0;
+        Executor::CancelToken token;
+        bool done = false;
+        bool unreachable = false;
+        SlideFrame slide;
+    };
+    HistoryWait historyWait;
+    bool waitingHistory = false; // UI thread
+    const int recentHistoryFrames = 15;
+    // Bytes of history frames from the memory governor, UI thread only
+    size_t historyMemoryLimit = std::numeric_limits<size_t>::max();
+
+    // Planned switch as steady_clock ticks, 0 when none is planned.
+    // deadlineLate raises the preparation to interactive work.
+    std::atomic<std::chrono::steady_clock::rep> switchDeadline{0};
+    std::atomic<bool> deadlineLate{false};
+    std::chrono::milliseconds switchLead{2000};
+    std::function<void()> wakeup;
+    int lateDeadlines = 0;
+
+    // Open getNextImage request and how often and how long the UI waited on
+    // the ring or a history load; the old blocking wait froze input for that long
+    bool waitingForNext = false;
+    bool waitingUserInitiated = false;
+    std::chrono::steady_clock::time_point stallStart;
+    int stallCount = 0;
+    double stallTotalMs = 0.0;
+    double stallMaxMs = 0.0;
+
+    // Recent taps, +1 for next and -1 for previous. History prefetch reaches
+    // further in the direction of travel the faster the taps come.
+    std::deque<std::pair<std::chrono::steady_clock::time_point, int>> navigation;
+    const std::chrono::seconds navigationWindow{3};
+    const int minHistoryLookahead = 2;
+    const int maxHistoryLookahead = 12;
+
+    // Decoded slides from the preparation task to the UI. The UI swaps a slot
+    // with currentImg, so getting the next frame never locks or allocates.
+    // readyMutex and readyCondVar are only used to wait for the background
+    // tasks on shutdown. The ring only fills up to prefetch.depth().
+    static const size_t maxBufferSize = 16;
+    FrameRing<SlideFrame> readyFrames{maxBufferSize};
+    PrefetchController prefetch;
+    // Bytes of the slides in the ring, added before the publish and taken
+    // off when the UI takes the slide
+    std::atomic<size_t> queuedBytes{0};
+    std::mutex readyMutex;
+    std::condition_variable readyCondVar;
+    int tasksInFlight = 0;
+    Executor* executor = nullptr;
+    // At most one preparation task is queued or running, preloadToken is
+    // its token (guarded by preloadTokenMutex) to raise it once it is urgent
+    std::atomic<bool> preloadScheduled{false};
+    std::mutex preloadTokenMutex;
+    Executor::CancelToken preloadToken;
+    // Set as steady_clock ticks by a preparation task that found nothing to do, 0 while it runs
+    std::atomic<std::chrono::steady_clock::rep> preloadRetryAt{0};
+    // The UI asked for a slide the ring did not have, preparation runs as interactive work
+    std::atomic<bool> uiWaiting{false};
+    std::mt19937 gen{std::random_device{}()};
+    // Served last from memory while the source is down, preparation task only
+    std::string lastCachedPath;
+    std::atomic<bool> stopThread;
     bool showDate = true;
     bool showImgCount = true;
     bool showFldrName = true;
 
-    const int bufferSize = 5;
-    const int prevImageBufferSize = 15;
-    int currentBufferIndex = 99;   
+    // Overlay text, glyphs are rasterized once per size at startup
+    std::string fontPath = "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf";
+    std::unique_ptr<TextRenderer> textRenderer;
+    const int dateFontSize = 26;
+    const int countFontSize = 22;
+
+    // Anti-aliased rounded box masks keyed by (width, height, radius)
+    std::map<std::tuple<int, int, int>, cv::Mat> roundedMasks;
+    const size_t maxRoundedMasks = 64;
+
+    // Overlay offsets of the slide on screen, animation frames reuse them
+    cv::Point dateShift;
+    cv::Point countShift;
+
+    // Ken Burns: zoom at the end of the motion relative to the letterbox fit,
+    // 1 for no motion. The motion ends at the most detailed region or the center.
+    double kenBurnsZoom = 1.3;
+    bool kenBurnsSubjectFocus = true;
+    SlideFrame shownSlide;
+
     bool first = true;
     bool x = false;
     
-    std::pair<std::string, cv::Mat> currentImg;
+    SlideFrame currentImg;
+    cv::Mat presentFrame;
+
+    // Image the preparation task is currently decoding and its embedded preview,
+    // guarded by inFlightMutex. A tap past the preview cancels inFlightToken.
+    std::mutex inFlightMutex;
+    Executor::CancelToken inFlightToken;
+    std::string inFlightPath;
+    SlideFrame inFlightPreview;
+    // Path currently shown as a preview, waiting for the full decode
+    std::string pendingRefinePath;
+
+    // Zoom state of the image on screen. zoomCache holds the decoded part
+    // around the viewport in displayed orientation, bounded by zoomMemoryBudget.
+    // zoomDecoder holds the file read into memory and decodes on the UI thread
+    std::unique_ptr<RegionDecoder> zoomDecoder;
+    int zoomOrientation = 1;
+    cv::Size zoomImageSize;
+    double zoomScale = 0.0; // screen pixels per image pixel, 0 when not zoomed
+    cv::Point2d zoomCenter;
+    cv::Rect zoomCachedRegion;
+    cv::Mat zoomCache;
+    int zoomCacheDenom = 0;
+    size_t zoomMemoryBudget = 64 * 1024 * 1024;
+    // From the memory governor, only the viewport itself may exceed it
+    size_t zoomMemoryLimit = std::numeric_limits<size_t>::max();
+    const std::chrono::milliseconds zoomIoTimeout{5000};
  
 };
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include "EventLoop.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace {
+    // steady_clock is CLOCK_MONOTONIC, the timerfd clock
+    itimerspec absoluteTime(std::chrono::steady_clock::time_point deadline) {
+        itimerspec spec{};
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+        // A zero value disarms the timer, a deadline at the epoch has passed anyway
+        if (ns <= 0) ns = 1;
+        spec.it_value.tv_sec = static_cast<time_t>(ns / 1000000000);
+        spec.it_value.tv_nsec = static_cast<long>(ns % 1000000000);
+        return spec;
+    }
+
+    void drain(int fd) {
+        uint64_t value;
+        while (read(fd, &value, sizeof(value)) == sizeof(value)) {
+        }
+    }
+}
+
+EventLoop::EventLoop()
+{
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd < 0 || timerFd < 0 || eventFd < 0 || !watch(timerFd) || !watch(eventFd)) {
+        std::cerr << "EventLoop: setup failed (" << std::strerror(errno) << "), falling back to polling" << std::endl;
+        if (epollFd >= 0) close(epollFd);
+        if (timerFd >= 0) close(timerFd);
+        if (eventFd >= 0) close(eventFd);
+        epollFd = timerFd = eventFd = -1;
+    }
+    statsSince = std::chrono::steady_clock::now();
+}
+
+EventLoop::~EventLoop()
+{
+    if (epollFd >= 0) close(epollFd);
+    if (timerFd >= 0) close(timerFd);
+    if (eventFd >= 0) close(eventFd);
+}
+
+bool EventLoop::isOpen() const
+{
+    return epollFd >= 0;
+}
+
+bool EventLoop::watch(int fd)
+{
+    if (epollFd < 0 || fd < 0) return false;
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+void EventLoop::notify()
+{
+    if (eventFd < 0) return;
+    uint64_t one = 1;
+    ssize_t written = write(eventFd, &one, sizeof(one));
+    (void)written; // only fails when the counter is saturated, the loop wakes up anyway
+}
+
+EventLoop::Wake EventLoop::wait(std::chrono::steady_clock::time_point deadline)
+{
+    if (epollFd < 0) return Wake::Error;
+
+    bool timed = deadline != std::chrono::steady_clock::time_point::max();
+    itimerspec spec = timed ? absoluteTime(deadline) : itimerspec{};
+    timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+
+    epoll_event events[4];
+    int count;
+    do {
+        count = epoll_wait(epollFd, events, 4, -1);
+    } while (count < 0 && errno == EINTR);
+    if (count < 0) return Wake::Error;
+
+    // Input wins, the caller handles it first anyway
+    Wake wake = Wake::Timer;
+    bool input = false;
+    bool notified = false;
+    for (int i = 0; i < count; ++i) {
+        int fd = events[i].data.fd;
+        if (fd == timerFd) {
+            drain(timerFd);
+        } else if (fd == eventFd) {
+            drain(eventFd);
+            notified = true;
+        } else {
+            input = true;
+        }
+    }
+    if (input) {
+        wake = Wake::Input;
+        inputWakeups++;
+    } else if (notified) {
+        wake = Wake::Notify;
+        notifyWakeups++;
+    } else {
+        timerWakeups++;
+    }
+    return wake;
+}
+
+void EventLoop::logStats()
+{
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - statsSince).count();
+    if (!isOpen() || seconds <= 0.0) return;
+
+    size_t total = timerWakeups + inputWakeups + notifyWakeups;
+    std::cout << "Main loop: " << total / seconds << " wakeups/s (" << timerWakeups << " timer, " << inputWakeups
+              << " input, " << notifyWakeups << " pipeline in " << seconds << " s)" << std::endl;
+    timerWakeups = 0;
+    inputWakeups = 0;
+    notifyWakeups = 0;
+    statsSince = now;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <chrono>
+
+// Blocks the main loop in epoll until something needs it: input on a
+// watched descriptor (the X connection), the absolute deadline of the next
+// timed step (through a timerfd) or a notify() from a pipeline thread
+// (through an eventfd). An idle slideshow wakes up once per slide instead of
+// a hundred times a second.
+class EventLoop {
+public:
+    enum class Wake { Timer, Input, Notify, Error };
+
+    EventLoop();
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    bool isOpen() const;
+
+    // A readable fd ends the wait
+    bool watch(int fd);
+
+    // Wakes a running or the next wait(), safe from any thread
+    void notify();
+
+    // Waits until deadline at the latest, time_point::max() for no deadline
+    Wake wait(std::chrono::steady_clock::time_point deadline);
+
+    // Wakeups per second since the last call, split by what woke the loop
+    void logStats();
+
+private:
+    int epollFd = -1;
+    int timerFd = -1;
+    int eventFd = -1;
+
+    size_t timerWakeups = 0;
+    size_t inputWakeups = 0;
+    size_t notifyWakeups = 0;
+    std::chrono::steady_clock::time_point statsSince;
+};
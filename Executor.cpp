@@ -0,0 +1,313 @@
+#include "Executor.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace {
+    const char* priorityNames[Executor::priorityCount] = { "interactive", "prefetch", "index", "maintenance" };
+
+    // Index of the worker running on this thread, -1 on any other thread
+    thread_local int currentWorker = -1;
+    thread_local const Executor* currentExecutor = nullptr;
+
+    double msBetween(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    }
+}
+
+Executor::CancelToken::CancelToken()
+: cancelled(std::make_shared<std::atomic<bool>>(false))
+{
+}
+
+void Executor::CancelToken::cancel() const
+{
+    cancelled->store(true);
+}
+
+bool Executor::CancelToken::isCancelled() const
+{
+    return cancelled->load();
+}
+
+bool Executor::CancelToken::operator==(const CancelToken& other) const
+{
+    return cancelled == other.cancelled;
+}
+
+Executor::Executor(int threads, const std::array<ThreadPolicy, priorityCount>& policies)
+{
+    if (threads <= 0) {
+        threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+    }
+
+    std::array<ThreadPolicy, priorityCount> configured = policies;
+    basePolicy = ThreadPolicy::current();
+    for (int p = 0; p < priorityCount; ++p) {
+        this->policies[p] = configured[p].resolvedAgainst(basePolicy);
+    }
+    if (std::any_of(configured.begin(), configured.end(), [](const ThreadPolicy& policy) { return !policy.isInherit(); })) {
+        probePolicies(configured);
+    }
+
+    for (int i = 0; i < threads; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (int i = 0; i < threads; ++i) {
+        workers[i]->thread = std::thread(&Executor::run, this, static_cast<size_t>(i));
+    }
+    std::cout << "Executor: " << threads << " worker threads" << std::endl;
+    for (int p = 0; p < priorityCount; ++p) {
+        if (configured[p].isInherit()) continue;
+        std::cout << "Executor " << priorityNames[p] << " policy: " << configured[p].describe() << std::endl;
+    }
+}
+
+void Executor::probePolicies(std::array<ThreadPolicy, priorityCount>& configured)
+{
+    // On a scratch thread: a policy the system refuses is dropped, and
+    // without CAP_SYS_NICE or a high enough RLIMIT_NICE a worker could not
+    // get back from idle or a higher nice value to serve interactive work
+    bool restoreFailed = false;
+    std::thread probe([&]() {
+        for (int p = 0; p < priorityCount; ++p) {
+            if (configured[p].isInherit()) continue;
+            if (!policies[p].apply()) {
+                std::cerr << "Executor " << priorityNames[p] << " policy " << configured[p].describe() << " refused ("
+                          << std::strerror(errno) << "), left as is" << std::endl;
+                configured[p] = ThreadPolicy();
+                policies[p] = basePolicy;
+            }
+            if (!basePolicy.apply()) restoreFailed = true;
+        }
+    });
+    probe.join();
+
+    if (restoreFailed) {
+        std::cerr << "Executor: switching the scheduling class per task needs CAP_SYS_NICE or a higher RLIMIT_NICE, "
+                  << "workers only switch cores and I/O class" << std::endl;
+        for (int p = 0; p < priorityCount; ++p) {
+            configured[p].scheduling = ThreadPolicy::Scheduling::Inherit;
+            policies[p].scheduling = basePolicy.scheduling;
+            policies[p].nice = basePolicy.nice;
+            policies[p].rtPriority = basePolicy.rtPriority;
+        }
+    }
+}
+
+Executor::~Executor()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+Executor::CancelToken Executor::submit(Priority priority, Task task, CancelToken token)
+{
+    int p = static_cast<int>(priority);
+
+    // Work spawned by a task stays on its worker while it is not stolen
+    size_t target = currentExecutor == this ? static_cast<size_t>(currentWorker)
+                                             : nextWorker.fetch_add(1) % workers.size();
+
+    Item item;
+    item.task = std::move(task);
+    item.token = token;
+    item.queued = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(workers[target]->mutex);
+        workers[target]->queues[p].push_back(std::move(item));
+    }
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        counters[p].submitted++;
+        counters[p].depth++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        pending++;
+    }
+    wake.notify_one();
+    return token;
+}
+
+bool Executor::raise(const CancelToken& token, Priority priority)
+{
+    int to = static_cast<int>(priority);
+    std::vector<int> moved;
+    bool raised = false;
+
+    for (size_t self = 0; self < workers.size(); ++self) {
+        Worker& worker = *workers[self];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        for (int p = to + 1; p < priorityCount; ++p) {
+            auto& queue = worker.queues[p];
+            for (auto it = queue.begin(); it != queue.end();) {
+                if (it->token == token) {
+                    worker.queues[to].push_back(std::move(*it));
+                    it = queue.erase(it);
+                    moved.push_back(p);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        if (worker.running && worker.runningPriority > to && worker.runningToken == token) {
+            worker.runningPriority = to;
+            switchPolicy(worker, self, to);
+            raised = true;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    for (int p : moved) {
+        counters[p].submitted--;
+        counters[p].depth--;
+        counters[to].submitted++;
+        counters[to].depth++;
+    }
+    return raised || !moved.empty();
+}
+
+void Executor::switchPolicy(Worker& worker, size_t self, int priority)
+{
+    if (policies[priority] == *worker.applied) return;
+    if (!policies[priority].apply(worker.tid) && !worker.policyWarned) {
+        std::cerr << "Executor: worker " << self << " could not switch to the " << priorityNames[priority] << " policy ("
+                  << std::strerror(errno) << ")" << std::endl;
+        worker.policyWarned = true;
+    }
+    worker.applied = &policies[priority];
+}
+
+int Executor::threadCount() const
+{
+    return static_cast<int>(workers.size());
+}
+
+bool Executor::take(size_t self, Item& item, int& priority)
+{
+    // A more urgent task anywhere wins over a less urgent one in the own queue
+    for (int p = 0; p < priorityCount; ++p) {
+        for (size_t n = 0; n < workers.size(); ++n) {
+            size_t victim = (self + n) % workers.size();
+            Worker& worker = *workers[victim];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            auto& queue = worker.queues[p];
+            if (queue.empty()) continue;
+
+            // Own queue in submit order, steals from the far end
+            if (victim == self) {
+                item = std::move(queue.front());
+                queue.pop_front();
+            } else {
+                item = std::move(queue.back());
+                queue.pop_back();
+            }
+            priority = p;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Executor::run(size_t self)
+{
+    currentWorker = static_cast<int>(self);
+    currentExecutor = this;
+    Worker& worker = *workers[self];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.tid = ThreadPolicy::currentThreadId();
+        worker.applied = &basePolicy;
+    }
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this]() { return pending > 0 || stopping; });
+            if (stopping) return;
+            pending--;
+        }
+
+        // pending counts queued items, so one is there for this worker
+        Item item;
+        int p = 0;
+        while (!take(self, item, p)) {
+            std::this_thread::yield();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        bool cancelled = item.token.isCancelled();
+        if (!cancelled) {
+            {
+                // Under the lock, raise() may switch the policy from another thread
+                std::lock_guard<std::mutex> lock(worker.mutex);
+                switchPolicy(worker, self, p);
+                worker.running = true;
+                worker.runningToken = item.token;
+                worker.runningPriority = p;
+            }
+            item.task(item.token);
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.running = false;
+        }
+        auto done = std::chrono::steady_clock::now();
+
+        std::lock_guard<std::mutex> lock(statsMutex);
+        Counters& c = counters[p];
+        c.depth--;
+        if (cancelled) {
+            c.cancelled++;
+            continue;
+        }
+        double wait = msBetween(item.queued, start);
+        c.completed++;
+        c.waitTotalMs += wait;
+        c.waitMaxMs = std::max(c.waitMaxMs, wait);
+        c.intervalWaitMaxMs = std::max(c.intervalWaitMaxMs, wait);
+        c.runTotalMs += msBetween(start, done);
+    }
+}
+
+Executor::ClassStats Executor::getStats(Priority priority) const
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    const Counters& c = counters[static_cast<int>(priority)];
+    ClassStats stats;
+    stats.submitted = c.submitted;
+    stats.completed = c.completed;
+    stats.cancelled = c.cancelled;
+    stats.depth = c.depth;
+    stats.waitAvgMs = c.completed ? c.waitTotalMs / c.completed : 0.0;
+    stats.waitMaxMs = c.waitMaxMs;
+    stats.runAvgMs = c.completed ? c.runTotalMs / c.completed : 0.0;
+    return stats;
+}
+
+void Executor::logStats()
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    for (int p = 0; p < priorityCount; ++p) {
+        Counters& c = counters[p];
+        Counters& last = lastLogged[p];
+        size_t completed = c.completed - last.completed;
+        size_t cancelled = c.cancelled - last.cancelled;
+        if (c.submitted == last.submitted && completed == 0 && cancelled == 0) continue;
+
+        std::cout << "Executor " << priorityNames[p] << ": " << completed << " done, " << cancelled << " cancelled, "
+                  << c.depth << " queued, wait " << (completed ? (c.waitTotalMs - last.waitTotalMs) / completed : 0.0)
+                  << " ms avg / " << c.intervalWaitMaxMs << " ms max, run "
+                  << (completed ? (c.runTotalMs - last.runTotalMs) / completed : 0.0) << " ms avg" << std::endl;
+        c.intervalWaitMaxMs = 0.0;
+        last = c;
+    }
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ThreadPolicy.h"
+
+// Runs all background work (slide preparation, scans, db.json writes) on a
+// fixed set of worker threads instead of one thread per job. Every worker
+// has its own queues, one per priority class; an idle worker steals from the
+// others, always taking the most urgent class first. Tasks get a
+// cancellation token they check between expensive steps, a task whose token
+// was cancelled before it started is dropped without running.
+// Each priority class can have its own thread policy (cores, scheduling
+// class, I/O priority); a worker switches to it before running a task of
+// that class. Work that became urgent is raised to a more urgent class,
+// queued or running.
+class Executor {
+public:
+    // Most urgent first
+    enum class Priority { Interactive, Prefetch, Index, Maintenance };
+    static const int priorityCount = 4;
+
+    class CancelToken {
+    public:
+        CancelToken();
+        void cancel() const;
+        bool isCancelled() const;
+        bool operator==(const CancelToken& other) const;
+    private:
+        std::shared_ptr<std::atomic<bool>> cancelled;
+    };
+
+    using Task = std::function<void(const CancelToken&)>;
+
+    struct ClassStats {
+        size_t submitted = 0;
+        size_t completed = 0;
+        size_t cancelled = 0;  // dropped before they ran
+        size_t depth = 0;      // queued right now
+        double waitAvgMs = 0.0; // from submit to start
+        double waitMaxMs = 0.0;
+        double runAvgMs = 0.0;
+    };
+
+    // threads <= 0 picks one per core, leaving a core for the UI. Policies
+    // are resolved against the calling thread, construct before changing
+    // its own policy.
+    explicit Executor(int threads = 0, const std::array<ThreadPolicy, priorityCount>& policies = {});
+    // Queued tasks are dropped, running ones are waited for
+    ~Executor();
+
+    // Queues a task, from a worker it goes to that worker's own queue.
+    // Returns the token the task checks, pass one in to cancel a group at once.
+    CancelToken submit(Priority priority, Task task, CancelToken token = CancelToken());
+
+    // Moves the queued tasks of token to a more urgent class, a running one
+    // has its worker switched to that class's policy right away. It is
+    // counted in the class it started in. False when nothing was raised.
+    bool raise(const CancelToken& token, Priority priority);
+
+    int threadCount() const;
+
+    // Totals since startup
+    ClassStats getStats(Priority priority) const;
+
+    // Logs the classes that had work since the last call
+    void logStats();
+
+private:
+    struct Item {
+        Task task;
+        CancelToken token;
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::array<std::deque<Item>, priorityCount> queues;
+        std::thread thread;
+
+        // The task running and the policy the thread has, for raise()
+        int tid = 0;
+        bool running = false;
+        CancelToken runningToken;
+        int runningPriority = 0;
+        const ThreadPolicy* applied = nullptr;
+        bool policyWarned = false;
+    };
+
+    struct Counters {
+        size_t submitted = 0;
+        size_t completed = 0;
+        size_t cancelled = 0;
+        size_t depth = 0;
+        double waitTotalMs = 0.0;
+        double waitMaxMs = 0.0;
+        double runTotalMs = 0.0;
+        double intervalWaitMaxMs = 0.0; // since the last logStats()
+    };
+
+    void run(size_t self);
+    void probePolicies(std::array<ThreadPolicy, priorityCount>& configured);
+    bool take(size_t self, Item& item, int& priority);
+    // With worker.mutex held
+    void switchPolicy(Worker& worker, size_t self, int priority);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> nextWorker{0};
+
+    // What workers start with and what they switch to per class
+    ThreadPolicy basePolicy;
+    std::array<ThreadPolicy, priorityCount> policies;
+
+    // Workers sleep here when no queue has work
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    size_t pending = 0;
+    bool stopping = false;
+
+    mutable std::mutex statsMutex;
+    std::array<Counters, priorityCount> counters;
+    std::array<Counters, priorityCount> lastLogged;
+};
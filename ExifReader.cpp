@@ -0,0 +1,391 @@
+#include "ExifReader.h"
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+    // JPEG marker lengths are always big endian, independent of the TIFF byte order
+    uint16_t be16(const unsigned char* p) {
+        return static_cast<uint16_t>((p[0] << 8) | p[1]);
+    }
+
+    const uint16_t typeAscii = 2;
+    const uint16_t typeShort = 3;
+    const uint16_t typeRational = 5;
+
+    const uint16_t tagNewSubFileType = 0x00FE;
+    const uint16_t tagCompression = 0x0103;
+    const uint16_t tagStripOffsets = 0x0111;
+    const uint16_t tagOrientation = 0x0112;
+    const uint16_t tagStripByteCounts = 0x0117;
+    const uint16_t tagSubIfds = 0x014A;
+    const uint16_t tagDateTime = 0x0132;
+    const uint16_t tagExifIfd = 0x8769;
+    const uint16_t tagGpsIfd = 0x8825;
+    const uint16_t tagDateTimeOriginal = 0x9003;
+    const uint16_t tagGpsLatitudeRef = 0x0001;
+    const uint16_t tagGpsLatitude = 0x0002;
+    const uint16_t tagGpsLongitudeRef = 0x0003;
+    const uint16_t tagGpsLongitude = 0x0004;
+    const uint16_t tagJpegOffset = 0x0201;
+    const uint16_t tagJpegLength = 0x0202;
+    const uint16_t tagMpEntry = 0xB002;
+}
+
+ExifReader::ExifReader(const std::string& filePath)
+{
+    fd = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    ssize_t n = pread(fd, head, headSize, 0);
+    headLength = n > 0 ? static_cast<size_t>(n) : 0;
+
+    if (headLength >= 4 && head[0] == 0xFF && head[1] == 0xD8) {
+        jpeg = true;
+        parseSegments();
+    } else if (headLength >= 8 && ((head[0] == 'I' && head[1] == 'I') || (head[0] == 'M' && head[1] == 'M'))) {
+        // Plain TIFF containers start with the TIFF header itself
+        tiff = true;
+        parseTiff(0, headLength);
+    }
+}
+
+ExifReader::~ExifReader()
+{
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+bool ExifReader::isJpeg() const {
+    return jpeg;
+}
+
+int ExifReader::getOrientation() const {
+    return orientation;
+}
+
+bool ExifReader::isTiff() const {
+    return tiff;
+}
+
+bool ExifReader::hasExif() const {
+    return exif;
+}
+
+const char* ExifReader::getDateTimeOriginal() const {
+    return dateTimeOriginal;
+}
+
+const char* ExifReader::getDateTime() const {
+    return dateTime;
+}
+
+bool ExifReader::hasGps() const {
+    return gps;
+}
+
+double ExifReader::getLatitude() const {
+    return latitudeRef == 'S' ? -latitude : latitude;
+}
+
+double ExifReader::getLongitude() const {
+    return longitudeRef == 'W' ? -longitude : longitude;
+}
+
+bool ExifReader::hasPreview() const {
+    return previewLength > 0 || thumbLength > 0;
+}
+
+bool ExifReader::readAt(uint64_t offset, unsigned char* buffer, size_t length)
+{
+    if (fd < 0) return false;
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = pread(fd, buffer + done, length - done, static_cast<off_t>(offset + done));
+        if (n <= 0) return false;
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+uint16_t ExifReader::get16(const unsigned char* p) const {
+    return littleEndian ? static_cast<uint16_t>(p[0] | (p[1] << 8))
+                        : static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+uint32_t ExifReader::get32(const unsigned char* p) const {
+    return littleEndian ? (uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24))
+                        : ((uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]));
+}
+
+void ExifReader::parseSegments()
+{
+    size_t pos = 2;
+
+    // Only the header segments are of interest, stop at the start of scan
+    for (int segment = 0; segment < 32 && pos + 4 <= headLength; ++segment) {
+        if (head[pos] != 0xFF) break;
+        unsigned char marker = head[pos + 1];
+        if (marker == 0xFF) { pos++; continue; } // fill byte
+        if (marker == 0xDA || marker == 0xD9) break;
+
+        size_t length = be16(head + pos + 2);
+        if (length < 2) break;
+
+        size_t dataOffset = pos + 4;
+        size_t dataLength = length - 2;
+        if (dataOffset + dataLength > headLength) {
+            dataLength = headLength - dataOffset;
+        }
+
+        if (marker == 0xE1 && dataLength > 6 && std::memcmp(head + dataOffset, "Exif\0\0", 6) == 0) {
+            parseTiff(dataOffset + 6, dataLength - 6);
+        } else if (marker == 0xE2 && dataLength > 4 && std::memcmp(head + dataOffset, "MPF\0", 4) == 0) {
+            parseApp2(dataOffset + 4, dataLength - 4);
+        }
+
+        pos += 2 + length;
+    }
+}
+
+void ExifReader::parseTiff(size_t offset, size_t length)
+{
+    const unsigned char* base = head + offset;
+    if (length < 8) return;
+
+    if (base[0] == 'I' && base[1] == 'I') littleEndian = true;
+    else if (base[0] == 'M' && base[1] == 'M') littleEndian = false;
+    else return;
+    if (get16(base + 2) != 42) return;
+
+    exif = true;
+
+    // IFD0 holds orientation, date and the sub-IFD pointers, IFD1 the thumbnail
+    uint32_t ifd1Offset = parseIfd(offset, length, get32(base + 4), IfdKind::Ifd0);
+    if (ifd1Offset != 0) {
+        parseIfd(offset, length, ifd1Offset, IfdKind::Ifd1);
+    }
+}
+
+uint32_t ExifReader::parseIfd(size_t offset, size_t length, uint32_t ifdOffset, IfdKind kind)
+{
+    const unsigned char* base = head + offset;
+    if (ifdOffset < 8 || ifdOffset + 2ull > length) return 0;
+
+    uint16_t count = get16(base + ifdOffset);
+    if (ifdOffset + 2ull + count * 12ull + 4 > length) return 0;
+
+    uint32_t exifOffset = 0, gpsOffset = 0;
+    uint32_t jpegOffset = 0, jpegLength = 0;
+    uint32_t stripOffset = 0, stripLength = 0;
+    uint32_t compression = 0, subFileType = 0;
+    uint32_t subIfdCount = 0, subIfdOffset = 0;
+
+    for (uint16_t i = 0; i < count; ++i) {
+        const unsigned char* entry = base + ifdOffset + 2 + i * 12;
+        uint16_t tag = get16(entry);
+
+        // Image data layout, needed to find the JPEG previews inside RAW files
+        if (kind == IfdKind::Ifd0 || kind == IfdKind::Ifd1 || kind == IfdKind::SubIfd) {
+            bool isShort = get16(entry + 2) == typeShort;
+            uint32_t value = isShort ? get16(entry + 8) : get32(entry + 8);
+            bool single = get32(entry + 4) == 1;
+
+            if (tag == tagJpegOffset) jpegOffset = value;
+            else if (tag == tagJpegLength) jpegLength = value;
+            else if (tag == tagCompression) compression = value;
+            else if (tag == tagNewSubFileType) subFileType = value;
+            else if (tag == tagStripOffsets && single) stripOffset = value;
+            else if (tag == tagStripByteCounts && single) stripLength = value;
+            else if (tag == tagSubIfds && kind == IfdKind::Ifd0) {
+                subIfdCount = get32(entry + 4);
+                subIfdOffset = get32(entry + 8);
+            }
+        }
+
+        switch (kind) {
+            case IfdKind::Ifd0:
+                if (tag == tagOrientation) {
+                    int value = get16(entry + 8);
+                    if (value >= 1 && value <= 8) orientation = value;
+                } else if (tag == tagDateTime) {
+                    copyAscii(base, length, entry, dateTime);
+                } else if (tag == tagExifIfd) {
+                    exifOffset = get32(entry + 8);
+                } else if (tag == tagGpsIfd) {
+                    gpsOffset = get32(entry + 8);
+                }
+                break;
+            case IfdKind::Ifd1:
+            case IfdKind::SubIfd:
+                break;
+            case IfdKind::Exif:
+                if (tag == tagDateTimeOriginal) {
+                    copyAscii(base, length, entry, dateTimeOriginal);
+                }
+                break;
+            case IfdKind::Gps:
+                if (tag == tagGpsLatitudeRef) latitudeRef = static_cast<char>(entry[8]);
+                else if (tag == tagGpsLongitudeRef) longitudeRef = static_cast<char>(entry[8]);
+                else if (tag == tagGpsLatitude) { latitude = readGpsCoordinate(base, length, entry); gps = true; }
+                else if (tag == tagGpsLongitude) longitude = readGpsCoordinate(base, length, entry);
+                break;
+        }
+    }
+
+    if (tiff) {
+        // RAW containers: offsets are file offsets and the data lies beyond the head.
+        // Strips only count when they hold a baseline JPEG or a DNG preview,
+        // never the lossless sensor data.
+        if (jpegLength > 0) {
+            addPreviewCandidate(jpegOffset, jpegLength);
+        }
+        if (stripLength > 0 && (compression == 6 || (compression == 7 && subFileType == 1))) {
+            addPreviewCandidate(stripOffset, stripLength);
+        }
+    } else if (kind == IfdKind::Ifd1 && jpegLength > 0 && jpegOffset + static_cast<uint64_t>(jpegLength) <= length) {
+        thumbOffset = offset + jpegOffset;
+        thumbLength = jpegLength;
+    }
+
+    if (subIfdCount == 1) {
+        parseIfd(offset, length, subIfdOffset, IfdKind::SubIfd);
+    } else if (subIfdCount > 1 && subIfdOffset + subIfdCount * 4ull <= length) {
+        for (uint32_t i = 0; i < subIfdCount && i < maxSubIfds; ++i) {
+            parseIfd(offset, length, get32(base + subIfdOffset + i * 4), IfdKind::SubIfd);
+        }
+    }
+    if (exifOffset != 0) {
+        parseIfd(offset, length, exifOffset, IfdKind::Exif);
+    }
+    if (gpsOffset != 0) {
+        parseIfd(offset, length, gpsOffset, IfdKind::Gps);
+    }
+
+    return get32(base + ifdOffset + 2 + count * 12);
+}
+
+void ExifReader::copyAscii(const unsigned char* base, size_t length, const unsigned char* entry, char* out)
+{
+    // Date strings are 20 bytes including the terminator, so always stored out of line
+    uint32_t count = get32(entry + 4);
+    uint32_t valueOffset = get32(entry + 8);
+    if (get16(entry + 2) != typeAscii || count < 19 || valueOffset + 19ull > length) return;
+
+    std::memcpy(out, base + valueOffset, 19);
+    out[19] = '\0';
+}
+
+double ExifReader::readGpsCoordinate(const unsigned char* base, size_t length, const unsigned char* entry)
+{
+    // Three RATIONALs: degrees, minutes, seconds
+    uint32_t valueOffset = get32(entry + 8);
+    if (get16(entry + 2) != typeRational || get32(entry + 4) != 3 || valueOffset + 24ull > length) return 0.0;
+
+    double value = 0.0;
+    double divisor = 1.0;
+    for (int i = 0; i < 3; ++i) {
+        uint32_t numerator = get32(base + valueOffset + i * 8);
+        uint32_t denominator = get32(base + valueOffset + i * 8 + 4);
+        if (denominator != 0) {
+            value += static_cast<double>(numerator) / denominator / divisor;
+        }
+        divisor *= 60.0;
+    }
+    return value;
+}
+
+void ExifReader::addPreviewCandidate(uint64_t offset, uint32_t length)
+{
+    if (length > previewLength && length <= maxPreviewSize) {
+        previewOffset = offset;
+        previewLength = length;
+    }
+}
+
+void ExifReader::parseApp2(size_t offset, size_t length)
+{
+    // The MPF block has its own TIFF header; entry offsets are relative to it
+    const unsigned char* base = head + offset;
+    if (length < 8) return;
+
+    bool exifLittleEndian = littleEndian;
+    if (base[0] == 'I' && base[1] == 'I') littleEndian = true;
+    else if (base[0] == 'M' && base[1] == 'M') littleEndian = false;
+    else return;
+
+    uint32_t ifdOffset = get32(base + 4);
+    if (ifdOffset + 2ull <= length) {
+        uint16_t count = get16(base + ifdOffset);
+        for (uint16_t i = 0; i < count && ifdOffset + 2ull + (i + 1) * 12ull <= length; ++i) {
+            const unsigned char* entry = base + ifdOffset + 2 + i * 12;
+            if (get16(entry) != tagMpEntry) continue;
+
+            uint32_t entriesLength = get32(entry + 4);
+            uint32_t entriesOffset = get32(entry + 8);
+            if (entriesOffset + static_cast<uint64_t>(entriesLength) > length) break;
+
+            // Entry 0 is the primary image, pick the largest of the others
+            for (uint32_t e = 1; e < entriesLength / 16; ++e) {
+                const unsigned char* mp = base + entriesOffset + e * 16;
+                uint32_t size = get32(mp + 4);
+                uint32_t dataOffset = get32(mp + 8);
+                if (dataOffset != 0) {
+                    addPreviewCandidate(offset + static_cast<uint64_t>(dataOffset), size);
+                }
+            }
+            break;
+        }
+    }
+
+    littleEndian = exifLittleEndian;
+}
+
+bool ExifReader::readPreview(std::vector<unsigned char>& jpegData)
+{
+    unsigned char soi[2];
+
+    if (previewLength > 0 && readAt(previewOffset, soi, 2) && soi[0] == 0xFF && soi[1] == 0xD8) {
+        jpegData.resize(previewLength);
+        if (readAt(previewOffset, jpegData.data(), previewLength)) {
+            return true;
+        }
+    }
+
+    if (thumbLength > 0 && thumbOffset + thumbLength <= headLength) {
+        jpegData.assign(head + thumbOffset, head + thumbOffset + thumbLength);
+        return true;
+    }
+
+    jpegData.clear();
+    return false;
+}
+
+bool ExifReader::readJpegSize(const std::vector<unsigned char>& jpegData, int& width, int& height)
+{
+    const unsigned char* p = jpegData.data();
+    size_t length = jpegData.size();
+    if (length < 4 || p[0] != 0xFF || p[1] != 0xD8) return false;
+
+    size_t pos = 2;
+    while (pos + 4 <= length) {
+        if (p[pos] != 0xFF) return false;
+        unsigned char marker = p[pos + 1];
+        if (marker == 0xFF) { pos++; continue; }
+        if (marker == 0xDA || marker == 0xD9) return false;
+
+        size_t segmentLength = be16(p + pos + 2);
+        bool isSof = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if (isSof) {
+            if (marker == 0xC3 || pos + 9 > length) return false;
+            height = be16(p + pos + 5);
+            width = be16(p + pos + 7);
+            return width > 0 && height > 0;
+        }
+        pos += 2 + segmentLength;
+    }
+    return false;
+}
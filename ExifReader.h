@@ -0,0 +1,84 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Reads the JPEG header segments (APP1 EXIF and APP2 MPF) without touching
+// the compressed image data. Everything it needs normally lives in the first
+// 64 KB of the file, so it is cheap enough to run before the full decode.
+// The reader works on a fixed buffer and does not allocate; Exiv2 is only
+// needed for containers it does not understand.
+class ExifReader {
+public:
+    explicit ExifReader(const std::string& filePath);
+    ~ExifReader();
+
+    bool isJpeg() const;
+    bool isTiff() const;
+    bool hasExif() const;
+    int getOrientation() const;
+    bool hasPreview() const;
+
+    // "YYYY:MM:DD HH:MM:SS" or an empty string
+    const char* getDateTimeOriginal() const;
+    const char* getDateTime() const;
+
+    bool hasGps() const;
+    double getLatitude() const;
+    double getLongitude() const;
+
+    // Copies the largest embedded JPEG preview (MPF preview image or the
+    // JPEG stored in a RAW file's IFDs if present, otherwise the IFD1
+    // thumbnail) into jpegData.
+    bool readPreview(std::vector<unsigned char>& jpegData);
+
+    // Reads the frame size from the SOF marker. Lossless JPEG (SOF3), as used
+    // for RAW sensor data, is rejected.
+    static bool readJpegSize(const std::vector<unsigned char>& jpegData, int& width, int& height);
+
+private:
+    static const size_t headSize = 72 * 1024;
+    static const size_t maxPreviewSize = 32 * 1024 * 1024;
+    static const int maxSubIfds = 4;
+
+    enum class IfdKind { Ifd0, Ifd1, SubIfd, Exif, Gps };
+
+    void parseSegments();
+    void parseTiff(size_t offset, size_t length);
+    uint32_t parseIfd(size_t offset, size_t length, uint32_t ifdOffset, IfdKind kind);
+    void parseApp2(size_t offset, size_t length);
+    void copyAscii(const unsigned char* base, size_t length, const unsigned char* entry, char* out);
+    double readGpsCoordinate(const unsigned char* base, size_t length, const unsigned char* entry);
+    void addPreviewCandidate(uint64_t offset, uint32_t length);
+    bool readAt(uint64_t offset, unsigned char* buffer, size_t length);
+
+    uint16_t get16(const unsigned char* p) const;
+    uint32_t get32(const unsigned char* p) const;
+
+    int fd = -1;
+    unsigned char head[headSize];
+    size_t headLength = 0;
+    bool littleEndian = false;
+
+    bool jpeg = false;
+    bool tiff = false;
+    bool exif = false;
+    int orientation = 1;
+
+    char dateTimeOriginal[20] = {};
+    char dateTime[20] = {};
+
+    bool gps = false;
+    char latitudeRef = 'N';
+    char longitudeRef = 'E';
+    double latitude = 0.0;
+    double longitude = 0.0;
+
+    // Absolute file offsets of the embedded JPEG streams
+    uint64_t thumbOffset = 0;
+    uint32_t thumbLength = 0;
+    uint64_t previewOffset = 0;
+    uint32_t previewLength = 0;
+};
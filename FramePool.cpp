@@ -0,0 +1,208 @@
+#include "FramePool.h"
+#include <algorithm>
+#include <new>
+#include <iostream>
+
+namespace {
+    // CV_AUTOSTEP from the C API, which opencv.hpp does not pull in
+    const size_t autoStep = 0x7fffffff;
+    // In front of every pooled block: its size class. Keeps fastMalloc's alignment.
+    const size_t blockHeader = 64;
+}
+
+FramePool::FramePool()
+{
+    // Recycled headers never make the list grow
+    freeHeaders.reserve(maxFreeHeaders);
+}
+
+FramePool& FramePool::instance()
+{
+    // Never destroyed: Mats released during static destruction still find their allocator
+    static FramePool* pool = new FramePool();
+    return *pool;
+}
+
+size_t FramePool::sizeClass(size_t bytes)
+{
+    // Eight classes per power of two, at most 12.5% slack per buffer
+    size_t power = 1;
+    while (power <= bytes / 2) power *= 2;
+    size_t step = std::max<size_t>(power / 8, 4096);
+    return (bytes + step - 1) / step * step;
+}
+
+cv::UMatData* FramePool::allocate(int dims, const int* sizes, int type, void* data0, size_t* step,
+                                  cv::AccessFlag, cv::UMatUsageFlags) const
+{
+    // Same layout rules as OpenCV's StdMatAllocator
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--) {
+        if (step) {
+            if (data0 && step[i] != autoStep) {
+                CV_Assert(total <= step[i]);
+                total = step[i];
+            } else {
+                step[i] = total;
+            }
+        }
+        total *= sizes[i];
+    }
+
+    uchar* data = data0 ? static_cast<uchar*>(data0)
+                        : total >= minPooledBytes ? static_cast<uchar*>(takeBlock(total))
+                                                  : static_cast<uchar*>(cv::fastMalloc(total));
+
+    // Headers of released Mats are reused, only a new high of live Mats needs the heap
+    void* storage = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!data0 && total < minPooledBytes) stats.smallAllocations++;
+        if (!freeHeaders.empty()) {
+            storage = freeHeaders.back();
+            freeHeaders.pop_back();
+        } else {
+            stats.headerAllocations++;
+        }
+    }
+    if (storage == nullptr) storage = ::operator new(sizeof(cv::UMatData));
+    cv::UMatData* u = new (storage) cv::UMatData(this);
+    u->data = u->origdata = data;
+    u->size = total;
+    if (data0) {
+        u->flags |= cv::UMatData::USER_ALLOCATED;
+    }
+    return u;
+}
+
+bool FramePool::allocate(cv::UMatData* u, cv::AccessFlag, cv::UMatUsageFlags) const
+{
+    return u != nullptr;
+}
+
+void* FramePool::takeBlock(size_t bytes) const
+{
+    size_t wanted = sizeClass(bytes);
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.requests++;
+
+    // A slightly larger idle buffer is better than a new one
+    for (auto it = freeBlocks.lower_bound(wanted); it != freeBlocks.end() && it->first <= wanted + wanted / 2; ++it) {
+        if (it->second.empty()) continue;
+        void* data = it->second.back().data;
+        it->second.pop_back();
+        stats.reused++;
+        stats.pooledBytes -= it->first;
+        stats.inUseBytes += it->first;
+        return data;
+    }
+
+    uchar* block = static_cast<uchar*>(cv::fastMalloc(wanted + blockHeader));
+    *reinterpret_cast<size_t*>(block) = wanted;
+    stats.systemAllocations++;
+    stats.inUseBytes += wanted;
+    return block + blockHeader;
+}
+
+void FramePool::deallocate(cv::UMatData* u) const
+{
+    if (!u) return;
+    CV_Assert(u->urefcount == 0);
+    CV_Assert(u->refcount == 0);
+
+    // Pooled blocks are told apart by the size allocate() recorded, OpenCV
+    // does not change it for CPU memory
+    if (!(u->flags & cv::UMatData::USER_ALLOCATED)) {
+        if (u->size >= minPooledBytes) {
+            uchar* block = u->origdata - blockHeader;
+            size_t size = *reinterpret_cast<size_t*>(block);
+            bool pooled = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stats.inUseBytes -= size;
+                if (stats.pooledBytes + size <= maxPooledBytes) {
+                    freeBlocks[size].push_back({ u->origdata, slide });
+                    stats.pooledBytes += size;
+                    pooled = true;
+                } else {
+                    stats.systemFrees++;
+                }
+            }
+            if (!pooled) {
+                cv::fastFree(block);
+            }
+        } else {
+            cv::fastFree(u->origdata);
+        }
+        u->origdata = 0;
+    }
+
+    u->~UMatData();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (freeHeaders.size() < maxFreeHeaders) {
+            freeHeaders.push_back(u);
+            return;
+        }
+    }
+    ::operator delete(u);
+}
+
+void FramePool::setMaxPooledBytes(size_t bytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        maxPooledBytes = bytes;
+    }
+    trim(bytes);
+}
+
+FramePool::Stats FramePool::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void FramePool::releaseBlocks(size_t targetBytes, uint64_t olderThan)
+{
+    // Caller holds the mutex. Largest classes first, they free the most per call.
+    for (auto it = freeBlocks.rbegin(); it != freeBlocks.rend(); ++it) {
+        std::vector<Block>& blocks = it->second;
+        for (size_t i = 0; i < blocks.size();) {
+            if (blocks[i].lastSlide < olderThan || stats.pooledBytes > targetBytes) {
+                cv::fastFree(static_cast<uchar*>(blocks[i].data) - blockHeader);
+                stats.pooledBytes -= it->first;
+                stats.systemFrees++;
+                blocks.erase(blocks.begin() + i);
+            } else {
+                ++i;
+            }
+        }
+    }
+}
+
+void FramePool::trim(size_t targetBytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    releaseBlocks(targetBytes, 0);
+}
+
+void FramePool::endSlide()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    slide++;
+
+    size_t allocations = stats.systemAllocations - lastSlideStats.systemAllocations;
+    size_t small = stats.smallAllocations - lastSlideStats.smallAllocations;
+    size_t headers = stats.headerAllocations - lastSlideStats.headerAllocations;
+    size_t reused = stats.reused - lastSlideStats.reused;
+    std::cout << "Frame pool: " << allocations << " heap allocations for frames, " << small << " small buffers, "
+              << headers << " Mat headers, " << reused << " reused this slide, "
+              << stats.pooledBytes / (1024 * 1024) << " MB idle, " << stats.inUseBytes / (1024 * 1024) << " MB in use" << std::endl;
+
+    if (slide > idleSlides) {
+        releaseBlocks(maxPooledBytes, slide - idleSlides);
+    }
+
+    lastSlideStats = stats;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+// cv::Mat allocator that keeps large buffers (decode buffers, screen frames)
+// in size-class free lists and hands them out again on the next slide, so a
+// frame that runs for weeks does not keep carving the heap. The Mat headers
+// are recycled as well. Small buffers go straight to cv::fastMalloc and are
+// counted apart. Installed as the default allocator in main().
+class FramePool : public cv::MatAllocator {
+public:
+    struct Stats {
+        size_t requests = 0;          // pooled-size allocations
+        size_t reused = 0;            // served from a free list
+        size_t systemAllocations = 0; // had to ask the heap
+        size_t smallAllocations = 0;  // below the pooled size, straight from the heap
+        size_t headerAllocations = 0; // Mat headers beyond the recycled ones
+        size_t systemFrees = 0;       // given back to the heap
+        size_t pooledBytes = 0;       // idle in the free lists
+        size_t inUseBytes = 0;        // handed out and not returned yet
+    };
+
+    static FramePool& instance();
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override;
+    bool allocate(cv::UMatData* data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override;
+    void deallocate(cv::UMatData* data) const override;
+
+    // Upper bound for idle buffers, anything beyond goes back to the heap
+    void setMaxPooledBytes(size_t bytes);
+
+    Stats getStats() const;
+
+    // Called once per slide change: logs the heap allocations since the last
+    // call and releases buffers that were not reused for a while. When the
+    // system is short of memory the MemoryGovernor trims the pool.
+    void endSlide();
+
+    // Frees idle buffers, largest first, until at most targetBytes are pooled
+    void trim(size_t targetBytes);
+
+private:
+    FramePool();
+
+    static size_t sizeClass(size_t bytes);
+    void* takeBlock(size_t bytes) const;
+    void releaseBlocks(size_t targetBytes, uint64_t olderThan);
+
+    struct Block {
+        void* data;
+        uint64_t lastSlide;
+    };
+
+    mutable std::mutex mutex;
+    mutable std::map<size_t, std::vector<Block>> freeBlocks;
+    // Storage of released cv::UMatData headers
+    mutable std::vector<void*> freeHeaders;
+    const size_t maxFreeHeaders = 1024;
+    mutable Stats stats;
+    Stats lastSlideStats;
+    uint64_t slide = 0;
+
+    size_t maxPooledBytes = 256u * 1024 * 1024;
+    const size_t minPooledBytes = 256 * 1024;
+    // Buffers not reused within this many slides are released
+    const uint64_t idleSlides = 30;
+};
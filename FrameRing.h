@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// Fixed-capacity single-producer/single-consumer ring of preallocated slots.
+// The producer fills the slot returned by writeSlot() in place and makes it
+// visible with publish(); the consumer takes the slot returned by readSlot()
+// and hands it back with release(). Neither side locks or allocates, the
+// head and tail counters are the only shared state.
+template <typename T>
+class FrameRing {
+public:
+    explicit FrameRing(size_t capacity)
+    : slots(capacity)
+    {
+    }
+
+    // Runs init on every slot, before the producer and consumer start
+    void prepare(const std::function<void(T&)>& init)
+    {
+        for (T& slot : slots) {
+            init(slot);
+        }
+    }
+
+    // Producer: next free slot, nullptr when the ring is full
+    T* writeSlot()
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == slots.size()) return nullptr;
+        return &slots[t % slots.size()];
+    }
+
+    void publish()
+    {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Consumer: oldest published slot, nullptr when the ring is empty
+    T* readSlot()
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return nullptr;
+        return &slots[h % slots.size()];
+    }
+
+    void release()
+    {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Either side may ask, the answer can be stale by the time it is used
+    size_t size() const
+    {
+        // head first, it never passes the tail read after it
+        size_t h = head.load(std::memory_order_acquire);
+        return tail.load(std::memory_order_acquire) - h;
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    size_t capacity() const
+    {
+        return slots.size();
+    }
+
+private:
+    std::vector<T> slots;
+    // Counters only grow, the slot is the counter modulo the capacity.
+    // Separate cache lines so the two threads do not bounce one line.
+    alignas(64) std::atomic<size_t> head{0}; // written by the consumer
+    alignas(64) std::atomic<size_t> tail{0}; // written by the producer
+};
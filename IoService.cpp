@@ -0,0 +1,227 @@
+#include "IoService.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace {
+    double msBetween(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    }
+}
+
+IoService& IoService::instance()
+{
+    // Never destroyed: abandoned threads may still come back during exit
+    static IoService* service = new IoService();
+    return *service;
+}
+
+void IoService::configure(std::chrono::milliseconds timeout, int failuresToTrip, std::chrono::seconds retryAfter)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    this->timeout = std::max(std::chrono::milliseconds(100), timeout);
+    this->failuresToTrip = std::max(1, failuresToTrip);
+    this->retryAfter = std::max(std::chrono::seconds(1), retryAfter);
+    retryInterval = this->retryAfter;
+}
+
+bool IoService::run(const std::string& what, std::function<void()> op, std::chrono::milliseconds limit)
+{
+    auto job = std::make_shared<Job>();
+    job->what = what;
+    job->op = std::move(op);
+    job->policy = ThreadPolicy::current();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    auto now = std::chrono::steady_clock::now();
+    bool probe = false;
+    if (down) {
+        if (probing || now < retryAt) {
+            refused++;
+            return false;
+        }
+        probing = true;
+        probe = true;
+    }
+    if (stuckThreads >= maxStuckThreads) {
+        // Nothing left to sacrifice until a stuck call comes back
+        refused++;
+        if (probe) {
+            probing = false;
+            retryAt = now + retryInterval;
+        }
+        return false;
+    }
+
+    queue.push_back(job);
+    if (idleThreads < static_cast<int>(queue.size())) {
+        std::thread(&IoService::work, this).detach();
+    } else {
+        jobReady.notify_one();
+    }
+
+    auto deadline = now + (limit.count() > 0 ? limit : timeout);
+    bool finished = jobDone.wait_until(lock, deadline, [&job]() { return job->done; });
+    now = std::chrono::steady_clock::now();
+    calls++;
+
+    if (finished) {
+        longestMs = std::max(longestMs, msBetween(job->start, now));
+        consecutiveTimeouts = 0;
+        if (down) {
+            std::cout << "I/O: source back after " << msBetween(downSince, now) / 1000 << " s" << std::endl;
+            down = false;
+            probing = false;
+            retryInterval = retryAfter;
+        }
+        return true;
+    }
+
+    timeouts++;
+    job->abandoned = true;
+    if (job->started) {
+        stuckThreads++;
+    } else {
+        queue.erase(std::find(queue.begin(), queue.end(), job));
+    }
+    std::cerr << "I/O: " << what << " missed its deadline, abandoned" << std::endl;
+
+    consecutiveTimeouts++;
+    if (probe) {
+        probing = false;
+        retryInterval = std::min(retryInterval * 2, maxRetry);
+        retryAt = now + retryInterval;
+        std::cerr << "I/O: source still down, next probe in " << retryInterval.count() << " s" << std::endl;
+    } else if (!down && consecutiveTimeouts >= failuresToTrip) {
+        down = true;
+        downSince = now;
+        retryInterval = retryAfter;
+        retryAt = now + retryInterval;
+        std::cerr << "I/O: source down after " << consecutiveTimeouts << " timeouts, next probe in " << retryInterval.count() << " s" << std::endl;
+    }
+    return false;
+}
+
+void IoService::work()
+{
+    ThreadPolicy applied = ThreadPolicy::current();
+    bool policyWarned = false;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        idleThreads++;
+        jobReady.wait(lock, [this]() { return !queue.empty(); });
+        idleThreads--;
+
+        std::shared_ptr<Job> job = queue.front();
+        queue.pop_front();
+        job->started = true;
+        job->start = std::chrono::steady_clock::now();
+        lock.unlock();
+
+        // A read for a background prefetch must not run with the UI's class
+        if (job->policy != applied) {
+            if (!job->policy.apply() && !policyWarned) {
+                std::cerr << "I/O: could not switch to the caller's thread policy (" << std::strerror(errno) << ")" << std::endl;
+                policyWarned = true;
+            }
+            applied = job->policy;
+        }
+
+        try {
+            job->op();
+        } catch (const std::exception& e) {
+            std::cerr << "I/O: " << job->what << " failed: " << e.what() << std::endl;
+        }
+
+        lock.lock();
+        job->done = true;
+        if (job->abandoned) {
+            stuckThreads--;
+            std::cout << "I/O: abandoned " << job->what << " returned after "
+                      << msBetween(job->start, std::chrono::steady_clock::now()) / 1000 << " s" << std::endl;
+        }
+        jobDone.notify_all();
+    }
+}
+
+bool IoService::readFile(const std::string& path, std::vector<unsigned char>& data, std::chrono::milliseconds timeout)
+{
+    return call<std::vector<unsigned char>>("read " + path, [path]() {
+        std::vector<unsigned char> bytes;
+        std::ifstream file(path, std::ios::binary);
+        if (file.is_open()) {
+            bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+        return bytes;
+    }, data, timeout);
+}
+
+bool IoService::exists(const std::string& path, bool& exists)
+{
+    return call<bool>("exists " + path, [path]() {
+        std::error_code error;
+        return fs::exists(path, error);
+    }, exists);
+}
+
+bool IoService::listDirectory(const std::string& path, std::vector<DirEntry>& entries)
+{
+    return call<std::vector<DirEntry>>("list " + path, [path]() {
+        std::vector<DirEntry> listed;
+        std::error_code error;
+        for (fs::directory_iterator it(path, error), end; !error && it != end; it.increment(error)) {
+            DirEntry entry;
+            entry.path = it->path().string();
+            std::error_code typeError;
+            entry.directory = it->is_directory(typeError);
+            entry.symlink = it->is_symlink(typeError);
+            entry.regular = it->is_regular_file(typeError);
+            listed.push_back(entry);
+        }
+        return listed;
+    }, entries);
+}
+
+bool IoService::isAvailable() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stuckThreads >= maxStuckThreads) return false;
+    return !down || (!probing && std::chrono::steady_clock::now() >= retryAt);
+}
+
+std::chrono::steady_clock::time_point IoService::nextAttempt() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto now = std::chrono::steady_clock::now();
+    auto next = now;
+    if (down) {
+        // A probe answers or times out within the deadline
+        next = probing ? now + timeout : std::max(now, retryAt);
+    }
+    if (stuckThreads >= maxStuckThreads) {
+        // Nothing tells when a stuck call comes back
+        next = std::max(next, now + retryAfter);
+    }
+    return next;
+}
+
+void IoService::logStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (calls == 0 && refused == 0) return;
+
+    std::cout << "I/O: " << calls << " calls, " << timeouts << " timed out, " << refused << " refused, longest "
+              << longestMs << " ms, " << stuckThreads << " threads stuck, source " << (down ? "down" : "up") << std::endl;
+    calls = 0;
+    timeouts = 0;
+    refused = 0;
+    longestMs = 0.0;
+}
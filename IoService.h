@@ -0,0 +1,105 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "ThreadPolicy.h"
+
+// Runs filesystem calls on the picture source, which can block for minutes
+// in the kernel when a CIFS server sleeps or the Wi-Fi drops, on sacrificial
+// threads with a deadline. A call past its deadline is abandoned: the caller
+// gets a failure, the thread stays stuck in the kernel and another one takes
+// over. It rejoins the pool if the call ever returns.
+// After failuresToTrip missed deadlines in a row the circuit breaker marks
+// the source as down. Calls then fail at once, except one probe per retry
+// interval (doubling up to maxRetry) that finds out whether it is back.
+// Operations must not capture references, they can outlive the call. They
+// run with the caller's thread policy: the threads are spawned by whoever
+// calls first, the UI thread included.
+class IoService {
+public:
+    struct DirEntry {
+        std::string path;
+        bool directory = false; // symlinks followed
+        bool symlink = false;
+        bool regular = false;
+    };
+
+    static IoService& instance();
+
+    void configure(std::chrono::milliseconds timeout, int failuresToTrip, std::chrono::seconds retryAfter);
+
+    // False when the deadline passed or the source is down. A timeout of 0
+    // uses the configured one.
+    bool run(const std::string& what, std::function<void()> op, std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+
+    template <typename T>
+    bool call(const std::string& what, std::function<T()> op, T& result, std::chrono::milliseconds timeout = std::chrono::milliseconds(0))
+    {
+        auto value = std::make_shared<T>();
+        if (!run(what, [op, value]() { *value = op(); }, timeout)) return false;
+        result = std::move(*value);
+        return true;
+    }
+
+    // Only false when the source did not answer in time: a missing file
+    // gives true with empty data, a missing directory no entries.
+    bool readFile(const std::string& path, std::vector<unsigned char>& data, std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+    bool exists(const std::string& path, bool& exists);
+    bool listDirectory(const std::string& path, std::vector<DirEntry>& entries);
+
+    // False while the source is down and no probe is due, or no thread is left to sacrifice
+    bool isAvailable() const;
+
+    // When isAvailable() may turn true: the next probe of a source that is
+    // down, a guess while a probe or stuck calls are out, now when available
+    std::chrono::steady_clock::time_point nextAttempt() const;
+
+    // Calls, timeouts and refusals since the last call, nothing when idle
+    void logStats();
+
+private:
+    struct Job {
+        std::string what;
+        std::function<void()> op;
+        ThreadPolicy policy;
+        bool started = false;
+        bool done = false;
+        bool abandoned = false;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    IoService() = default;
+    void work();
+
+    mutable std::mutex mutex;
+    std::condition_variable jobReady;
+    std::condition_variable jobDone;
+    std::deque<std::shared_ptr<Job>> queue;
+    int idleThreads = 0;
+    int stuckThreads = 0;
+    const int maxStuckThreads = 4;
+
+    std::chrono::milliseconds timeout{15000};
+    int failuresToTrip = 2;
+    std::chrono::seconds retryAfter{15};
+    const std::chrono::seconds maxRetry{300};
+
+    // Circuit breaker
+    int consecutiveTimeouts = 0;
+    bool down = false;
+    bool probing = false;
+    std::chrono::seconds retryInterval{15};
+    std::chrono::steady_clock::time_point retryAt;
+    std::chrono::steady_clock::time_point downSince;
+
+    size_t calls = 0;
+    size_t timeouts = 0;
+    size_t refused = 0;
+    double longestMs = 0.0;
+};
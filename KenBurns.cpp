@@ -0,0 +1,114 @@
+#include "KenBurns.h"
+#include <algorithm>
+#include <iostream>
+
+namespace {
+    double msSince(std::chrono::steady_clock::time_point since, std::chrono::steady_clock::time_point now) {
+        return std::chrono::duration<double, std::milli>(now - since).count();
+    }
+
+    // Below this share of the target frame rate the motion looks choppy
+    const double minRateShare = 0.8;
+}
+
+KenBurns::KenBurns(std::function<cv::Mat(double)> render, std::function<void(const cv::Mat&)> present)
+: render(std::move(render)), present(std::move(present))
+{
+}
+
+void KenBurns::configure(int fps)
+{
+    this->fps = std::max(0, fps);
+    period = std::chrono::microseconds(1000000 / std::max(1, fps));
+}
+
+void KenBurns::start(std::chrono::milliseconds duration)
+{
+    stop();
+    if (fps == 0 || duration <= period) return;
+
+    this->duration = duration;
+    active = true;
+    startTime = std::chrono::steady_clock::now();
+    lastFrame = 0;
+    windowStart = startTime;
+    windowFrames = 0;
+    shownFrames = 0;
+    droppedFrames = 0;
+    workTotalMs = 0.0;
+    workMaxMs = 0.0;
+}
+
+bool KenBurns::isActive() const {
+    return active;
+}
+
+void KenBurns::stop()
+{
+    if (active) {
+        finish("stopped");
+    }
+}
+
+int KenBurns::msUntilNextFrame() const
+{
+    if (!active) return -1;
+    auto deadline = startTime + period * (lastFrame + 1);
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    return std::max(0, static_cast<int>(remaining.count()));
+}
+
+void KenBurns::tick()
+{
+    if (!active) return;
+
+    auto now = std::chrono::steady_clock::now();
+    long frame = static_cast<long>((now - startTime) / period);
+    if (frame <= lastFrame) return;
+
+    droppedFrames += static_cast<int>(frame - lastFrame - 1);
+    lastFrame = frame;
+
+    // Positions follow the frame clock, so skipped frames do not slow the motion down
+    double progress = std::min(1.0, std::chrono::duration<double>(period * frame) / duration);
+    cv::Mat rendered = render(progress);
+    if (rendered.empty()) {
+        active = false;
+        return;
+    }
+    present(rendered);
+
+    auto done = std::chrono::steady_clock::now();
+    double work = msSince(now, done);
+    workTotalMs += work;
+    workMaxMs = std::max(workMaxMs, work);
+    shownFrames++;
+    windowFrames++;
+
+    if (progress >= 1.0) {
+        finish("done");
+        return;
+    }
+
+    double window = msSince(windowStart, done);
+    if (window >= 1000.0) {
+        double rate = windowFrames * 1000.0 / window;
+        if (rate < fps * minRateShare) {
+            std::cout << "Ken Burns: " << rate << " fps is below the target of " << fps << ", holding a still image" << std::endl;
+            finish("degraded");
+            return;
+        }
+        windowStart = done;
+        windowFrames = 0;
+    }
+}
+
+void KenBurns::finish(const char* reason)
+{
+    active = false;
+
+    double seconds = msSince(startTime, std::chrono::steady_clock::now()) / 1000.0;
+    std::cout << "Ken Burns " << reason << ": " << shownFrames << " frames shown, " << droppedFrames << " dropped, "
+              << (seconds > 0 ? shownFrames / seconds : 0.0) << " fps, warp+present "
+              << (shownFrames ? workTotalMs / shownFrames : 0.0) << " ms avg / " << workMaxMs << " ms max" << std::endl;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <opencv2/opencv.hpp>
+
+// Slow pan and zoom over the slide on screen. Frames are paced on a fixed
+// period like the crossfade steps: late frames are skipped, not shown late.
+// The render function draws the frame for a progress of 0..1 and returns an
+// empty Mat when the slide has nothing to animate. When the achieved frame
+// rate stays below the target, the animation stops and the last frame stays
+// on screen as a still image.
+class KenBurns {
+public:
+    KenBurns(std::function<cv::Mat(double)> render, std::function<void(const cv::Mat&)> present);
+
+    // A frame rate of 0 disables the animation
+    void configure(int fps);
+
+    // Animates from progress 0 to 1 over duration
+    void start(std::chrono::milliseconds duration);
+
+    bool isActive() const;
+
+    // Holds the frame on screen, e.g. when the slide switches or the user zooms
+    void stop();
+
+    // Renders and presents the next frame if its deadline has come
+    void tick();
+
+    // Milliseconds until the next frame is due, -1 without an animation
+    int msUntilNextFrame() const;
+
+private:
+    void finish(const char* reason);
+
+    std::function<cv::Mat(double)> render;
+    std::function<void(const cv::Mat&)> present;
+    int fps = 25;
+    std::chrono::microseconds period{40000};
+
+    bool active = false;
+    std::chrono::steady_clock::duration duration{};
+    std::chrono::steady_clock::time_point startTime;
+    long lastFrame = 0;
+
+    // Frame rate check over one second windows
+    std::chrono::steady_clock::time_point windowStart;
+    int windowFrames = 0;
+
+    // Frame-time statistics of the running animation
+    int shownFrames = 0;
+    int droppedFrames = 0;
+    double workTotalMs = 0.0;
+    double workMaxMs = 0.0;
+};
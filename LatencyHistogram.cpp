@@ -0,0 +1,48 @@
+#include "LatencyHistogram.h"
+#include <algorithm>
+#include <iostream>
+
+const double LatencyHistogram::bucketLimits[LatencyHistogram::bucketCount - 1] = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000 };
+
+LatencyHistogram::LatencyHistogram(std::string name)
+: name(std::move(name))
+{
+}
+
+void LatencyHistogram::add(double ms)
+{
+    int bucket = static_cast<int>(std::upper_bound(bucketLimits, bucketLimits + bucketCount - 1, ms) - bucketLimits);
+    buckets[bucket]++;
+    samples++;
+    totalMs += ms;
+    maxMs = std::max(maxMs, ms);
+}
+
+size_t LatencyHistogram::count() const
+{
+    return samples;
+}
+
+void LatencyHistogram::log() const
+{
+    if (samples == 0) return;
+
+    std::cout << name << " (" << samples << "):";
+    for (int i = 0; i < bucketCount; ++i) {
+        if (buckets[i] == 0) continue;
+        if (i < bucketCount - 1) {
+            std::cout << " <" << bucketLimits[i] << "ms " << buckets[i];
+        } else {
+            std::cout << " >=" << bucketLimits[bucketCount - 2] << "ms " << buckets[i];
+        }
+    }
+    std::cout << ", avg " << totalMs / samples << " ms, max " << maxMs << " ms" << std::endl;
+}
+
+void LatencyHistogram::reset()
+{
+    buckets.fill(0);
+    samples = 0;
+    totalMs = 0.0;
+    maxMs = 0.0;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <string>
+
+// Counts durations in fixed millisecond buckets (up to 1, 2, 5, 10, 20, 50,
+// 100, 200, 500, 1000 ms and above) plus mean and max, for timings that
+// should stay steady like slide switches against their deadline.
+class LatencyHistogram {
+public:
+    explicit LatencyHistogram(std::string name);
+
+    void add(double ms);
+    size_t count() const;
+
+    // One line with the non-empty buckets
+    void log() const;
+    void reset();
+
+private:
+    static const int bucketCount = 11;
+    static const double bucketLimits[bucketCount - 1];
+
+    std::string name;
+    std::array<size_t, bucketCount> buckets{};
+    size_t samples = 0;
+    double totalMs = 0.0;
+    double maxMs = 0.0;
+};
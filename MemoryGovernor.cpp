@@ -0,0 +1,139 @@
+#include "MemoryGovernor.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace {
+    const size_t megabyte = 1024 * 1024;
+}
+
+MemoryGovernor& MemoryGovernor::instance()
+{
+    static MemoryGovernor* governor = new MemoryGovernor();
+    return *governor;
+}
+
+bool MemoryGovernor::readMemInfo(size_t& total, size_t& available)
+{
+    std::ifstream meminfo("/proc/meminfo");
+    std::string line;
+    total = 0;
+    available = 0;
+    while (std::getline(meminfo, line)) {
+        std::istringstream fields(line);
+        std::string key;
+        size_t kilobytes = 0;
+        fields >> key >> kilobytes;
+        if (key == "MemTotal:") total = kilobytes * 1024;
+        else if (key == "MemAvailable:") available = kilobytes * 1024;
+    }
+    return total > 0;
+}
+
+void MemoryGovernor::configure(size_t ceilingBytes)
+{
+    size_t total = 0, available = 0;
+    readMemInfo(total, available);
+    ceiling = ceilingBytes > 0 ? ceilingBytes : total / 2;
+    std::cout << "Memory: ceiling " << ceiling / megabyte << " MB of " << total / megabyte << " MB" << std::endl;
+}
+
+void MemoryGovernor::addHolder(const std::string& name, std::function<size_t()> held, std::function<void(size_t)> limit)
+{
+    holders.push_back({ name, std::move(held), std::move(limit) });
+}
+
+void MemoryGovernor::addFixed(const std::string& name, std::function<size_t()> held)
+{
+    holders.push_back({ name, std::move(held), nullptr });
+}
+
+void MemoryGovernor::update()
+{
+    size_t total = 0, available = 0;
+    bool known = readMemInfo(total, available);
+    if (holders.empty() || (!known && ceiling == 0)) return;
+
+    std::vector<size_t> held;
+    size_t totalHeld = 0;
+    for (const Holder& holder : holders) {
+        held.push_back(holder.held());
+        totalHeld += held.back();
+    }
+
+    // What we hold could grow by what is available, minus a tenth of the
+    // memory for everything else on the system
+    size_t budget = ceiling;
+    if (known) {
+        size_t reserve = total / 10;
+        size_t usable = totalHeld + available > reserve ? totalHeld + available - reserve : 0;
+        if (ceiling == 0 || usable < budget) budget = usable;
+    }
+
+    std::cout << "Memory: " << totalHeld / megabyte << " MB held (";
+    for (size_t i = 0; i < holders.size(); ++i) {
+        std::cout << (i > 0 ? ", " : "") << holders[i].name << " " << held[i] / megabyte;
+    }
+    std::cout << "), budget " << budget / megabyte << " MB, " << available / megabyte << " MB available";
+    {
+        std::lock_guard<std::mutex> lock(trimMutex);
+        if (trims > 0) std::cout << ", " << trims << " heap trims in " << trimMs << " ms";
+        trims = 0;
+        trimMs = 0.0;
+    }
+    std::cout << std::endl;
+
+    size_t adjustable = std::count_if(holders.begin(), holders.end(), [](const Holder& holder) { return static_cast<bool>(holder.limit); });
+    if (adjustable == 0) return;
+
+    if (totalHeld <= budget) {
+        // Each holder may grow by its share of the free part, the limits
+        // add up to the budget. The rounding goes to the first one.
+        size_t headroom = budget - totalHeld;
+        size_t share = headroom / adjustable;
+        size_t rest = headroom - share * adjustable;
+        for (size_t i = 0; i < holders.size(); ++i) {
+            if (!holders[i].limit) continue;
+            holders[i].limit(held[i] + share + rest);
+            rest = 0;
+        }
+        return;
+    }
+
+    size_t excess = totalHeld - budget;
+    std::cout << "Memory: " << excess / megabyte << " MB over budget, shedding" << std::endl;
+    for (size_t i = 0; i < holders.size(); ++i) {
+        if (!holders[i].limit) continue;
+        size_t cut = std::min(excess, held[i]);
+        excess -= cut;
+        holders[i].limit(held[i] - cut);
+        if (cut > 0) {
+            std::cout << "Memory: " << holders[i].name << " " << held[i] / megabyte << " -> " << holders[i].held() / megabyte << " MB" << std::endl;
+        }
+    }
+}
+
+void MemoryGovernor::releaseTransient(size_t bytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(trimMutex);
+        transientBytes += bytes;
+        if (transientBytes < trimAfterBytes) return;
+        transientBytes = 0;
+    }
+
+#ifdef __GLIBC__
+    // Large decode buffers come back as free heap that glibc keeps around
+    auto start = std::chrono::steady_clock::now();
+    malloc_trim(0);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::lock_guard<std::mutex> lock(trimMutex);
+    trims++;
+    trimMs += ms;
+#endif
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Keeps the bytes held by the slide queue, the history, the zoom cache and
+// the frame pool within one budget: the configured ceiling, and never more
+// than MemAvailable leaves after a reserve for the rest of the system.
+// update() runs once per slide on the UI thread. It asks every holder what
+// it holds and hands each a limit: what it holds plus an equal share of the
+// free part of the budget while there is one, otherwise less, in
+// registration order (the cheapest to rebuild first) until the excess is
+// covered. Either way the limits add up to the budget, holders check their
+// limit when they grow. Fixed holders (screen buffers) count against the
+// budget but get no limit.
+class MemoryGovernor {
+public:
+    static MemoryGovernor& instance();
+
+    // 0 uses half of MemTotal
+    void configure(size_t ceilingBytes);
+
+    // held reports the bytes, limit is called on every update and frees down
+    // to its argument as far as the holder can. Both run on the UI thread.
+    void addHolder(const std::string& name, std::function<size_t()> held, std::function<void(size_t)> limit);
+    void addFixed(const std::string& name, std::function<size_t()> held);
+
+    // Reads /proc/meminfo, hands out the limits and logs
+    void update();
+
+    // After a decode that allocated and freed bytes outside the frame pool.
+    // Freed heap goes back to the system with malloc_trim once enough piled up.
+    void releaseTransient(size_t bytes);
+
+private:
+    struct Holder {
+        std::string name;
+        std::function<size_t()> held;
+        std::function<void(size_t)> limit; // empty for fixed holders
+    };
+
+    MemoryGovernor() = default;
+    static bool readMemInfo(size_t& total, size_t& available);
+
+    std::vector<Holder> holders;
+    size_t ceiling = 0;
+
+    // Transient bytes since the last trim, guarded by trimMutex
+    std::mutex trimMutex;
+    size_t transientBytes = 0;
+    size_t trims = 0;
+    double trimMs = 0.0;
+    const size_t trimAfterBytes = 48u * 1024 * 1024;
+};
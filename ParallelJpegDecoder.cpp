@@ -0,0 +1,219 @@
+#include "ParallelJpegDecoder.h"
+#include <algorithm>
+#include <atomic>
+
+namespace {
+    uint16_t be16(const unsigned char* p) {
+        return static_cast<uint16_t>((p[0] << 8) | p[1]);
+    }
+}
+
+ParallelJpegDecoder::ParallelJpegDecoder(const std::vector<unsigned char>& data)
+: data(data)
+{
+    splittable = parse();
+}
+
+cv::Size ParallelJpegDecoder::getImageSize() const {
+    return cv::Size(width, height);
+}
+
+bool ParallelJpegDecoder::canSplit() const {
+    return splittable;
+}
+
+size_t ParallelJpegDecoder::progressiveBytes() const {
+    return coefficientBytes;
+}
+
+bool ParallelJpegDecoder::parse()
+{
+    const unsigned char* p = data.data();
+    size_t length = data.size();
+    if (length < 4 || p[0] != 0xFF || p[1] != 0xD8) return false;
+
+    header.assign(p, p + 2);
+    bool baseline = false;
+    int components = 0;
+    size_t pos = 2;
+
+    while (pos + 4 <= length) {
+        if (p[pos] != 0xFF) return false;
+        unsigned char marker = p[pos + 1];
+        if (marker == 0xFF) { pos++; continue; }
+
+        size_t segmentLength = be16(p + pos + 2);
+        if (segmentLength < 2 || pos + 2 + segmentLength > length) return false;
+        const unsigned char* segment = p + pos + 4;
+
+        bool isSof = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if (isSof) {
+            if (segmentLength < 8) return false;
+            // Progressive, lossless and arithmetic coded frames cannot be split
+            baseline = marker == 0xC0 || marker == 0xC1;
+            height = be16(segment + 1);
+            width = be16(segment + 3);
+            components = segment[5];
+            if (segmentLength < 8 + 3u * components) return false;
+
+            int maxH = 1, maxV = 1;
+            for (int c = 0; c < components; ++c) {
+                maxH = std::max(maxH, segment[6 + c * 3 + 1] >> 4);
+                maxV = std::max(maxV, segment[6 + c * 3 + 1] & 0x0F);
+            }
+            // A single component scan is not interleaved, its MCU is one block
+            mcuWidth = components == 1 ? 8 : 8 * maxH;
+            mcuHeight = components == 1 ? 8 : 8 * maxV;
+
+            // Two bytes per coefficient of every block of every component
+            bool progressive = marker == 0xC2 || marker == 0xC6 || marker == 0xCA || marker == 0xCE;
+            coefficientBytes = 0;
+            for (int c = 0; progressive && c < components; ++c) {
+                size_t blocksWide = (static_cast<size_t>(width) * (segment[6 + c * 3 + 1] >> 4) / maxH + 7) / 8;
+                size_t blocksHigh = (static_cast<size_t>(height) * (segment[6 + c * 3 + 1] & 0x0F) / maxV + 7) / 8;
+                coefficientBytes += blocksWide * blocksHigh * 64 * 2;
+            }
+            sofHeightOffset = header.size() + 5;
+        } else if (marker == 0xDD) {
+            restartInterval = be16(segment);
+        }
+
+        if (marker == 0xDA) {
+            // Only a single interleaved scan covering all components can be split
+            if (!baseline || segment[0] != components) return false;
+            header.insert(header.end(), p + pos, p + pos + 2 + segmentLength);
+            return restartInterval > 0 && scanRestartMarkers(pos + 2 + segmentLength);
+        }
+
+        // Metadata is not needed by the band decoders. JFIF (APP0) and Adobe
+        // (APP14) stay, they tell the decoder how to convert the colors.
+        bool colorInfo = marker == 0xE0 || marker == 0xEE;
+        bool metadata = ((marker >= 0xE0 && marker <= 0xEF) || marker == 0xFE) && !colorInfo;
+        if (!metadata) {
+            header.insert(header.end(), p + pos, p + pos + 2 + segmentLength);
+        }
+        pos += 2 + segmentLength;
+    }
+    return false;
+}
+
+bool ParallelJpegDecoder::scanRestartMarkers(size_t start)
+{
+    const unsigned char* p = data.data();
+    size_t length = data.size();
+
+    entropyStart = start;
+    entropyEnd = length;
+    for (size_t i = start; i + 1 < length; ++i) {
+        if (p[i] != 0xFF) continue;
+        unsigned char next = p[i + 1];
+        if (next == 0x00 || next == 0xFF) continue; // stuffed byte or fill
+        if (next >= 0xD0 && next <= 0xD7) {
+            restartMarkers.push_back(i);
+            ++i;
+            continue;
+        }
+        entropyEnd = i; // EOI or another scan
+        break;
+    }
+
+    mcusPerRow = (width + mcuWidth - 1) / mcuWidth;
+    mcuRows = (height + mcuHeight - 1) / mcuHeight;
+    size_t totalMcus = static_cast<size_t>(mcusPerRow) * mcuRows;
+    size_t intervals = (totalMcus + restartInterval - 1) / restartInterval;
+    if (restartMarkers.size() + 1 != intervals) return false;
+
+    // Bands must start on an MCU row that is also the start of a restart interval
+    if (mcusPerRow % restartInterval == 0) {
+        rowsPerUnit = 1;
+        intervalsPerUnit = mcusPerRow / restartInterval;
+    } else if (restartInterval % mcusPerRow == 0) {
+        rowsPerUnit = restartInterval / mcusPerRow;
+        intervalsPerUnit = 1;
+    } else {
+        return false;
+    }
+    return mcuRows >= 2 * rowsPerUnit;
+}
+
+size_t ParallelJpegDecoder::segmentStart(size_t interval) const {
+    return interval == 0 ? entropyStart : restartMarkers[interval - 1] + 2;
+}
+
+size_t ParallelJpegDecoder::segmentEnd(size_t interval) const {
+    return interval < restartMarkers.size() ? restartMarkers[interval] : entropyEnd;
+}
+
+void ParallelJpegDecoder::buildBand(int firstRow, int lastRow, std::vector<unsigned char>& band) const
+{
+    size_t firstInterval = static_cast<size_t>(firstRow / rowsPerUnit) * intervalsPerUnit;
+    size_t lastInterval = std::min(static_cast<size_t>((lastRow + rowsPerUnit - 1) / rowsPerUnit) * intervalsPerUnit,
+                                   restartMarkers.size() + 1);
+
+    band.clear();
+    band.reserve(header.size() + segmentEnd(lastInterval - 1) - segmentStart(firstInterval) + 2);
+    band.insert(band.end(), header.begin(), header.end());
+
+    int bandHeight = std::min(height, lastRow * mcuHeight) - firstRow * mcuHeight;
+    band[sofHeightOffset] = static_cast<unsigned char>(bandHeight >> 8);
+    band[sofHeightOffset + 1] = static_cast<unsigned char>(bandHeight & 0xFF);
+
+    // Restart markers are renumbered so every band starts again at RST0
+    for (size_t interval = firstInterval; interval < lastInterval; ++interval) {
+        if (interval != firstInterval) {
+            band.push_back(0xFF);
+            band.push_back(static_cast<unsigned char>(0xD0 + ((interval - firstInterval - 1) & 7)));
+        }
+        band.insert(band.end(), data.begin() + segmentStart(interval), data.begin() + segmentEnd(interval));
+    }
+    band.push_back(0xFF);
+    band.push_back(0xD9);
+}
+
+cv::Mat ParallelJpegDecoder::decode(int flags, int maxBands)
+{
+    flags |= cv::IMREAD_IGNORE_ORIENTATION;
+    if (!splittable) {
+        return cv::imdecode(data, flags);
+    }
+
+    int scale = 1;
+    if ((flags & cv::IMREAD_REDUCED_COLOR_8) == cv::IMREAD_REDUCED_COLOR_8) scale = 8;
+    else if ((flags & cv::IMREAD_REDUCED_COLOR_4) == cv::IMREAD_REDUCED_COLOR_4) scale = 4;
+    else if ((flags & cv::IMREAD_REDUCED_COLOR_2) == cv::IMREAD_REDUCED_COLOR_2) scale = 2;
+
+    // Band heights are whole MCU rows, a multiple of every JPEG scale
+    int units = (mcuRows + rowsPerUnit - 1) / rowsPerUnit;
+    int bands = std::max(1, std::min(maxBands, units));
+    cv::Mat frame((height + scale - 1) / scale, (width + scale - 1) / scale, CV_8UC3);
+
+    std::atomic<bool> failed(false);
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range& range) {
+        std::vector<unsigned char> band;
+        for (int b = range.start; b < range.end; ++b) {
+            int firstRow = static_cast<int>(static_cast<long long>(units) * b / bands) * rowsPerUnit;
+            int lastRow = std::min(mcuRows, static_cast<int>(static_cast<long long>(units) * (b + 1) / bands) * rowsPerUnit);
+            buildBand(firstRow, lastRow, band);
+
+            // Decode straight into the rows of the output frame. Chroma upsampling
+            // does not see across band edges, which is invisible at screen scale.
+            int top = firstRow * mcuHeight / scale;
+            int bottom = std::min(frame.rows, lastRow * mcuHeight / scale);
+            cv::Mat rows = frame.rowRange(top, bottom);
+            cv::Mat decoded = cv::imdecode(band, flags, &rows);
+            if (decoded.empty() || decoded.data != rows.data) {
+                if (decoded.size() == rows.size() && decoded.type() == rows.type()) {
+                    decoded.copyTo(rows);
+                } else {
+                    failed = true;
+                }
+            }
+        }
+    }, bands);
+
+    if (failed) {
+        std::cerr << "Parallel JPEG decode failed, falling back to a single thread" << std::endl;
+        return cv::imdecode(data, flags);
+    }
+    return frame;
+}
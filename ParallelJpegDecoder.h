@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+
+// Splits a baseline JPEG that carries restart markers into horizontal bands
+// and decodes them on several cores. Every band is rebuilt as a standalone
+// JPEG (tables, SOF with the band height, the entropy-coded restart intervals
+// of its MCU rows) and decoded straight into its rows of the output frame.
+// Restart intervals reset the DC predictors, so the bands are independent.
+class ParallelJpegDecoder {
+public:
+    // Keeps a reference to data, which must outlive the decoder
+    explicit ParallelJpegDecoder(const std::vector<unsigned char>& data);
+
+    // Frame size from the SOF marker, empty if the header could not be read
+    cv::Size getImageSize() const;
+
+    // True if the file is baseline with restart intervals that line up with MCU rows
+    bool canSplit() const;
+
+    // Coefficients libjpeg keeps on the heap for a whole progressive frame
+    // at any scale, 0 for baseline
+    size_t progressiveBytes() const;
+
+    // Decodes with the given cv::imdecode flags (IMREAD_REDUCED_* is honoured,
+    // EXIF orientation is never applied) using up to maxBands threads.
+    cv::Mat decode(int flags, int maxBands);
+
+private:
+    bool parse();
+    bool scanRestartMarkers(size_t start);
+    void buildBand(int firstRow, int lastRow, std::vector<unsigned char>& band) const;
+    size_t segmentStart(size_t interval) const;
+    size_t segmentEnd(size_t interval) const;
+
+    const std::vector<unsigned char>& data;
+    bool splittable = false;
+
+    int width = 0;
+    int height = 0;
+    int mcuWidth = 8;
+    int mcuHeight = 8;
+    int mcusPerRow = 0;
+    int mcuRows = 0;
+    int restartInterval = 0;
+    size_t coefficientBytes = 0;
+    // Rows per group that starts on a restart interval boundary
+    int rowsPerUnit = 1;
+    int intervalsPerUnit = 1;
+
+    // Tables and frame header, of the APPn/COM segments only JFIF and Adobe; SOF height at sofHeightOffset
+    std::vector<unsigned char> header;
+    size_t sofHeightOffset = 0;
+
+    size_t entropyStart = 0;
+    size_t entropyEnd = 0;
+    std::vector<size_t> restartMarkers;
+};
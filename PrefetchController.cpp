@@ -0,0 +1,118 @@
+#include "PrefetchController.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace {
+    double percentile(std::vector<double> values, double fraction) {
+        if (values.empty()) return 0.0;
+        size_t index = std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()));
+        std::nth_element(values.begin(), values.begin() + index, values.end());
+        return values[index];
+    }
+}
+
+void PrefetchController::configure(int minDepth, int maxDepth, size_t budgetBytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    this->minDepth = std::max(1, minDepth);
+    this->maxDepth = std::max(this->minDepth, maxDepth);
+    this->budgetBytes = budgetBytes;
+    currentDepth = this->minDepth;
+    lowerWanted = 0;
+}
+
+void PrefetchController::setMemoryLimit(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    memoryLimit = bytes;
+    update();
+}
+
+void PrefetchController::addPrepared(double fetchMs, double decodeMs, double composeMs, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    samples.push_back({ fetchMs, decodeMs, composeMs, bytes });
+    if (samples.size() > maxSamples) samples.pop_front();
+    update();
+}
+
+void PrefetchController::addTap()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    taps.push_back(std::chrono::steady_clock::now());
+    if (taps.size() > maxTaps) taps.pop_front();
+    update();
+}
+
+int PrefetchController::depth() const
+{
+    return currentDepth;
+}
+
+void PrefetchController::update()
+{
+    if (samples.empty()) return;
+
+    std::vector<double> fetch, decode, compose, total, bytes;
+    for (const Sample& sample : samples) {
+        fetch.push_back(sample.fetchMs);
+        decode.push_back(sample.decodeMs);
+        compose.push_back(sample.composeMs);
+        total.push_back(sample.fetchMs + sample.decodeMs + sample.composeMs);
+        bytes.push_back(static_cast<double>(sample.bytes));
+    }
+    double prepareMs = percentile(total, 0.9);
+    double slideBytes = percentile(bytes, 0.9);
+
+    // Median interval of the recent taps, 0 when the user is not tapping
+    auto now = std::chrono::steady_clock::now();
+    while (!taps.empty() && now - taps.front() > tapWindow) taps.pop_front();
+    double tapMs = 0.0;
+    if (taps.size() >= 2) {
+        std::vector<double> intervals;
+        for (size_t i = 1; i < taps.size(); ++i) {
+            intervals.push_back(std::chrono::duration<double, std::milli>(taps[i] - taps[i - 1]).count());
+        }
+        tapMs = std::max(1.0, percentile(intervals, 0.5));
+    }
+
+    int wanted = minDepth;
+    if (tapMs > 0.0) wanted = static_cast<int>(std::ceil(prepareMs / tapMs)) + 1;
+    wanted = std::min(std::max(wanted, minDepth), maxDepth);
+    int budgetDepth = maxDepth;
+    size_t budget = budgetBytes > 0 ? std::min(budgetBytes, memoryLimit) : memoryLimit;
+    if (budget < std::numeric_limits<size_t>::max() && slideBytes > 0.0) {
+        budgetDepth = std::max(1, static_cast<int>(std::min<double>(maxDepth, budget / slideBytes)));
+    }
+    wanted = std::min(wanted, budgetDepth);
+
+    // Over budget shrinks at once, less demand only after a while
+    int depth = currentDepth;
+    int next = depth;
+    if (wanted > depth || depth > budgetDepth) {
+        next = wanted;
+        lowerWanted = 0;
+    } else if (wanted < depth) {
+        if (++lowerWanted >= shrinkAfter) {
+            next = depth - 1;
+            lowerWanted = 0;
+        }
+    } else {
+        lowerWanted = 0;
+    }
+    if (next == depth) return;
+    currentDepth = next;
+
+    std::cout << "Prefetch depth " << depth << " -> " << next << ": prepare p50 " << percentile(total, 0.5) << " / p90 "
+              << prepareMs << " ms (fetch " << percentile(fetch, 0.5) << " / " << percentile(fetch, 0.9) << ", decode "
+              << percentile(decode, 0.5) << " / " << percentile(decode, 0.9) << ", compose " << percentile(compose, 0.5)
+              << " / " << percentile(compose, 0.9) << "), ";
+    if (tapMs > 0.0) {
+        std::cout << "taps every " << tapMs << " ms";
+    } else {
+        std::cout << "no taps";
+    }
+    std::cout << ", " << slideBytes / (1024 * 1024) << " MB per slide, budget allows " << budgetDepth << std::endl;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <limits>
+#include <mutex>
+
+// Decides how many slides are prepared ahead. It keeps the recent fetch,
+// decode and compose times of prepared slides and the intervals between
+// taps; the depth covers the taps expected while one slide is prepared
+// (p90), plus the one being shown. It grows at once, shrinks only after the
+// lower depth was wanted for a while, never leaves min..max and never holds
+// more slides than the memory budget. Every change is logged.
+// Samples come from the preparation task, taps from the UI thread.
+class PrefetchController {
+public:
+    void configure(int minDepth, int maxDepth, size_t budgetBytes);
+
+    // Limit from the memory governor for the slides in the ring, on top of
+    // the configured budget. A lower one shrinks the depth at once.
+    void setMemoryLimit(size_t bytes);
+
+    // A prepared slide, bytes is what it holds in the ring
+    void addPrepared(double fetchMs, double decodeMs, double composeMs, size_t bytes);
+
+    // The user asked for the next slide
+    void addTap();
+
+    // Slides to keep ready right now
+    int depth() const;
+
+private:
+    struct Sample {
+        double fetchMs;
+        double decodeMs;
+        double composeMs;
+        size_t bytes;
+    };
+
+    void update();
+
+    mutable std::mutex mutex;
+    std::deque<Sample> samples;
+    std::deque<std::chrono::steady_clock::time_point> taps;
+    const size_t maxSamples = 32;
+    const size_t maxTaps = 8;
+    const std::chrono::seconds tapWindow{60};
+    const int shrinkAfter = 10; // updates in a row that wanted less
+
+    int minDepth = 2;
+    int maxDepth = 8;
+    size_t budgetBytes = 0;
+    size_t memoryLimit = std::numeric_limits<size_t>::max();
+    int lowerWanted = 0;
+    std::atomic<int> currentDepth{2};
+};
@@ -0,0 +1,245 @@
+#include "RegionDecoder.h"
+#include "ExifReader.h"
+#include <csetjmp>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <jpeglib.h>
+
+namespace {
+    // libjpeg reports fatal errors through error_exit, which must not return
+    struct JpegErrorManager {
+        jpeg_error_mgr pub;
+        jmp_buf setjmpBuffer;
+    };
+
+    void jpegErrorExit(j_common_ptr cinfo)
+    {
+        JpegErrorManager* manager = reinterpret_cast<JpegErrorManager*>(cinfo->err);
+        char message[JMSG_LENGTH_MAX];
+        (*cinfo->err->format_message)(cinfo, message);
+        std::cerr << "JPEG region decode error: " << message << std::endl;
+        longjmp(manager->setjmpBuffer, 1);
+    }
+
+    uint32_t readBig(const unsigned char* p, int bytes)
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < bytes; ++i) value = (value << 8) | p[i];
+        return value;
+    }
+
+    uint32_t readLittle(const unsigned char* p, int bytes)
+    {
+        uint32_t value = 0;
+        for (int i = bytes - 1; i >= 0; --i) value = (value << 8) | p[i];
+        return value;
+    }
+
+    // Pixel size from the header of a PNG, BMP, TIFF or JPEG file in memory,
+    // before anything is decoded
+    bool readHeaderSize(const std::vector<unsigned char>& data, cv::Size& size)
+    {
+        const unsigned char* p = data.data();
+        size_t length = data.size();
+        int width = 0, height = 0;
+
+        if (length >= 24 && std::memcmp(p, "\x89PNG\r\n\x1a\n", 8) == 0 && std::memcmp(p + 12, "IHDR", 4) == 0) {
+            width = static_cast<int>(std::min<uint32_t>(readBig(p + 16, 4), INT32_MAX));
+            height = static_cast<int>(std::min<uint32_t>(readBig(p + 20, 4), INT32_MAX));
+        } else if (length >= 26 && p[0] == 'B' && p[1] == 'M') {
+            // Negative heights are top-down bitmaps
+            width = std::abs(static_cast<int32_t>(readLittle(p + 18, 4)));
+            height = std::abs(static_cast<int32_t>(readLittle(p + 22, 4)));
+        } else if (length >= 8 && ((p[0] == 'I' && p[1] == 'I') || (p[0] == 'M' && p[1] == 'M'))) {
+            // Width and length tags of the first IFD, SHORT or LONG
+            auto read = [p](const unsigned char* at, int bytes) { return p[0] == 'I' ? readLittle(at, bytes) : readBig(at, bytes); };
+            if (read(p + 2, 2) != 42) return false;
+            uint64_t ifd = read(p + 4, 4);
+            if (ifd + 2 > length) return false;
+            uint32_t entries = read(p + ifd, 2);
+            for (uint32_t i = 0; i < entries && ifd + 2 + (i + 1) * 12ull <= length; ++i) {
+                const unsigned char* entry = p + ifd + 2 + i * 12;
+                uint32_t tag = read(entry, 2);
+                uint32_t type = read(entry + 2, 2);
+                if ((tag != 256 && tag != 257) || (type != 3 && type != 4)) continue;
+                int value = static_cast<int>(std::min<uint32_t>(read(entry + 8, type == 3 ? 2 : 4), INT32_MAX));
+                (tag == 256 ? width : height) = value;
+            }
+        } else if (!ExifReader::readJpegSize(data, width, height)) {
+            return false;
+        }
+
+        size = cv::Size(width, height);
+        return width > 0 && height > 0;
+    }
+
+    // Decodes the rows of region at 1/scaleDenom into band, view is the
+    // region within it. Kept apart from any C++ object with a
+    // destructor: a longjmp would skip it. band belongs to the caller and
+    // is released there either way.
+    bool readJpegRows(const std::vector<unsigned char>& data, const cv::Rect& region, int scaleDenom, cv::Mat& band, cv::Rect& view)
+    {
+        jpeg_decompress_struct cinfo;
+        JpegErrorManager errorManager;
+        cinfo.err = jpeg_std_error(&errorManager.pub);
+        errorManager.pub.error_exit = jpegErrorExit;
+
+        if (setjmp(errorManager.setjmpBuffer)) {
+            jpeg_destroy_decompress(&cinfo);
+            return false;
+        }
+
+        jpeg_create_decompress(&cinfo);
+        jpeg_mem_src(&cinfo, data.data(), static_cast<unsigned long>(data.size()));
+        jpeg_read_header(&cinfo, TRUE);
+
+        cinfo.scale_num = 1;
+        cinfo.scale_denom = static_cast<unsigned int>(scaleDenom);
+        cinfo.out_color_space = JCS_EXT_BGR;
+        jpeg_start_decompress(&cinfo);
+
+        // Region in scaled output coordinates
+        JDIMENSION x = static_cast<JDIMENSION>(region.x / scaleDenom);
+        JDIMENSION y = static_cast<JDIMENSION>(region.y / scaleDenom);
+        JDIMENSION width = std::min(cinfo.output_width - x, static_cast<JDIMENSION>((region.width + scaleDenom - 1) / scaleDenom));
+        JDIMENSION height = std::min(cinfo.output_height - y, static_cast<JDIMENSION>((region.height + scaleDenom - 1) / scaleDenom));
+
+        // Cropping snaps to iMCU boundaries, so the decoded columns may start further left
+        JDIMENSION cropX = x;
+        JDIMENSION cropWidth = width;
+        if (x > 0 || width < cinfo.output_width) {
+            jpeg_crop_scanline(&cinfo, &cropX, &cropWidth);
+        }
+
+        if (y > 0) {
+            jpeg_skip_scanlines(&cinfo, y);
+        }
+
+        band.create(static_cast<int>(height), static_cast<int>(cinfo.output_width), CV_8UC3);
+        for (JDIMENSION row = 0; row < height; ++row) {
+            JSAMPROW rowPointer = band.ptr<JSAMPLE>(static_cast<int>(row));
+            jpeg_read_scanlines(&cinfo, &rowPointer, 1);
+        }
+
+        // The remaining rows are not needed
+        jpeg_abort_decompress(&cinfo);
+        jpeg_destroy_decompress(&cinfo);
+        view = cv::Rect(static_cast<int>(x - cropX), 0, static_cast<int>(width), static_cast<int>(height));
+        return true;
+    }
+}
+
+RegionDecoder::RegionDecoder(std::vector<unsigned char> data, size_t memoryBudget)
+: data(std::move(data)), memoryBudget(memoryBudget)
+{
+    jpeg = readJpegHeader();
+    if (jpeg) return;
+
+    // No region access for this format: decoded whole, so only when the
+    // header promises a bitmap within the budget
+    cv::Size headerSize;
+    std::vector<unsigned char> file;
+    file.swap(this->data);
+    if (!readHeaderSize(file, headerSize)) {
+        std::cerr << "Zoom: no size in the header, not decoding the whole file" << std::endl;
+        return;
+    }
+    double bytes = static_cast<double>(headerSize.width) * headerSize.height * 3;
+    if (bytes > memoryBudget) {
+        std::cerr << "Zoom: " << headerSize.width << "x" << headerSize.height
+                  << " has no region access and exceeds the zoom memory budget" << std::endl;
+        return;
+    }
+
+    fallbackImage = cv::imdecode(file, cv::IMREAD_COLOR | cv::IMREAD_IGNORE_ORIENTATION);
+    if (fallbackImage.size() != headerSize) {
+        // Another image than the header described, e.g. a multi-page TIFF
+        fallbackImage.release();
+        return;
+    }
+    imageSize = headerSize;
+}
+
+bool RegionDecoder::isOpen() const {
+    return imageSize.width > 0 && imageSize.height > 0;
+}
+
+cv::Size RegionDecoder::getImageSize() const {
+    return imageSize;
+}
+
+size_t RegionDecoder::residentBytes() const {
+    return data.capacity() + fallbackImage.total() * fallbackImage.elemSize();
+}
+
+int RegionDecoder::scaleDenomFor(double outputScale)
+{
+    int denom = 8;
+    while (denom > 1 && 1.0 / denom < outputScale) {
+        denom /= 2;
+    }
+    return denom;
+}
+
+bool RegionDecoder::readJpegHeader()
+{
+    if (data.empty()) return false;
+
+    jpeg_decompress_struct cinfo;
+    JpegErrorManager errorManager;
+    cinfo.err = jpeg_std_error(&errorManager.pub);
+    errorManager.pub.error_exit = jpegErrorExit;
+
+    if (setjmp(errorManager.setjmpBuffer)) {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, data.data(), static_cast<unsigned long>(data.size()));
+    bool ok = jpeg_read_header(&cinfo, TRUE) == JPEG_HEADER_OK
+              && cinfo.jpeg_color_space != JCS_CMYK && cinfo.jpeg_color_space != JCS_YCCK;
+    if (ok) {
+        imageSize = cv::Size(static_cast<int>(cinfo.image_width), static_cast<int>(cinfo.image_height));
+    }
+
+    jpeg_destroy_decompress(&cinfo);
+    return ok;
+}
+
+cv::Mat RegionDecoder::decodeRegion(const cv::Rect& region, int scaleDenom)
+{
+    cv::Rect clipped = region & cv::Rect(0, 0, imageSize.width, imageSize.height);
+    if (clipped.empty()) return cv::Mat();
+
+    size_t bytes = static_cast<size_t>(clipped.width / scaleDenom + 1) * (clipped.height / scaleDenom + 1) * 3;
+    if (bytes > memoryBudget) {
+        std::cerr << "Region " << clipped.width << "x" << clipped.height << " at 1/" << scaleDenom
+                  << " exceeds the zoom memory budget" << std::endl;
+        return cv::Mat();
+    }
+
+    return jpeg ? decodeJpegRegion(clipped, scaleDenom) : decodeFallbackRegion(clipped, scaleDenom);
+}
+
+cv::Mat RegionDecoder::decodeJpegRegion(const cv::Rect& region, int scaleDenom)
+{
+    cv::Mat band;
+    cv::Rect view;
+    if (!readJpegRows(data, region, scaleDenom, band, view)) return cv::Mat();
+
+    // A view into the band, the extra iMCU columns are cheaper than a copy
+    return band(view);
+}
+
+cv::Mat RegionDecoder::decodeFallbackRegion(const cv::Rect& region, int scaleDenom)
+{
+    if (fallbackImage.empty()) return cv::Mat();
+    if (scaleDenom == 1) return fallbackImage(region).clone(); // oriented in place by the caller
+
+    cv::Mat result;
+    cv::resize(fallbackImage(region), result,
+               cv::Size(std::max(1, region.width / scaleDenom), std::max(1, region.height / scaleDenom)), 0, 0, cv::INTER_LINEAR);
+    return result;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+// Decodes a rectangular part of an image at a reduced scale without holding
+// the full bitmap. JPEGs use libjpeg-turbo's scaled decoding together with
+// jpeg_crop_scanline/jpeg_skip_scanlines, so only the rows and iMCU columns
+// of the region are produced. Other formats have no region access: they
+// are decoded whole, so they are only opened when the size in their header
+// fits into the memory budget.
+//
+// Works on the file read into memory, the picture source is only touched
+// by whoever reads it. Coordinates are in the stored (not EXIF rotated)
+// orientation.
+class RegionDecoder {
+public:
+    RegionDecoder(std::vector<unsigned char> data, size_t memoryBudget);
+
+    bool isOpen() const;
+    cv::Size getImageSize() const;
+
+    // Kept between regions: the JPEG file or the full decode of another format
+    size_t residentBytes() const;
+
+    // Smallest power of two JPEG scale (1, 2, 4 or 8) that still gives
+    // at least outputScale decoded pixels per image pixel.
+    static int scaleDenomFor(double outputScale);
+
+    // Returns the region decoded at 1/scaleDenom, or an empty Mat if it would
+    // not fit into the memory budget.
+    cv::Mat decodeRegion(const cv::Rect& region, int scaleDenom);
+
+private:
+    bool readJpegHeader();
+    cv::Mat decodeJpegRegion(const cv::Rect& region, int scaleDenom);
+    cv::Mat decodeFallbackRegion(const cv::Rect& region, int scaleDenom);
+
+    // The compressed file, kept for JPEGs
+    std::vector<unsigned char> data;
+    size_t memoryBudget;
+    bool jpeg = false;
+    cv::Size imageSize;
+
+    // Full decode of non-JPEG files, never larger than the budget
+    cv::Mat fallbackImage;
+};
@@ -0,0 +1,85 @@
+#include "RenderTarget.h"
+#include <algorithm>
+
+cv::Size RenderTarget::logicalSize() const
+{
+    return rotation % 180 ? cv::Size(size.height, size.width) : size;
+}
+
+cv::Point RenderTarget::toPhysical(cv::Point logical) const
+{
+    // Same layout as cv::rotate with ROTATE_90_CLOCKWISE, ROTATE_180 and ROTATE_90_COUNTERCLOCKWISE
+    switch (rotation) {
+        case 90: return cv::Point(size.width - 1 - logical.y, logical.x);
+        case 180: return cv::Point(size.width - 1 - logical.x, size.height - 1 - logical.y);
+        case 270: return cv::Point(logical.y, size.height - 1 - logical.x);
+        default: return logical;
+    }
+}
+
+cv::Point RenderTarget::toLogical(cv::Point physical) const
+{
+    switch (rotation) {
+        case 90: return cv::Point(physical.y, size.width - 1 - physical.x);
+        case 180: return cv::Point(size.width - 1 - physical.x, size.height - 1 - physical.y);
+        case 270: return cv::Point(size.height - 1 - physical.y, physical.x);
+        default: return physical;
+    }
+}
+
+cv::Rect RenderTarget::toPhysical(const cv::Rect& logical) const
+{
+    if (logical.empty()) return cv::Rect();
+    cv::Point a = toPhysical(logical.tl());
+    cv::Point b = toPhysical(cv::Point(logical.x + logical.width - 1, logical.y + logical.height - 1));
+    return cv::Rect(std::min(a.x, b.x), std::min(a.y, b.y), std::abs(a.x - b.x) + 1, std::abs(a.y - b.y) + 1);
+}
+
+cv::Matx23d RenderTarget::fromPhysical(const cv::Matx23d& m) const
+{
+    // Scanout pixel to upright pixel, the inverse of toPhysical
+    cv::Matx23d p(1, 0, 0, 0, 1, 0);
+    switch (rotation) {
+        case 90: p = cv::Matx23d(0, 1, 0, -1, 0, size.width - 1); break;
+        case 180: p = cv::Matx23d(-1, 0, size.width - 1, 0, -1, size.height - 1); break;
+        case 270: p = cv::Matx23d(0, -1, size.height - 1, 1, 0, 0); break;
+        default: break;
+    }
+    return cv::Matx23d(m(0, 0) * p(0, 0) + m(0, 1) * p(1, 0), m(0, 0) * p(0, 1) + m(0, 1) * p(1, 1), m(0, 0) * p(0, 2) + m(0, 1) * p(1, 2) + m(0, 2),
+                       m(1, 0) * p(0, 0) + m(1, 1) * p(1, 0), m(1, 0) * p(0, 1) + m(1, 1) * p(1, 1), m(1, 0) * p(0, 2) + m(1, 1) * p(1, 2) + m(1, 2));
+}
+
+void RenderTarget::rotateToPhysical(const cv::Mat& upright, cv::Mat& physical) const
+{
+    switch (rotation) {
+        case 90: cv::rotate(upright, physical, cv::ROTATE_90_CLOCKWISE); break;
+        case 180: cv::rotate(upright, physical, cv::ROTATE_180); break;
+        case 270: cv::rotate(upright, physical, cv::ROTATE_90_COUNTERCLOCKWISE); break;
+        default: upright.copyTo(physical); break;
+    }
+}
+
+void RenderTarget::rotateToLogical(const cv::Mat& physical, cv::Mat& upright) const
+{
+    switch (rotation) {
+        case 90: cv::rotate(physical, upright, cv::ROTATE_90_COUNTERCLOCKWISE); break;
+        case 180: cv::rotate(physical, upright, cv::ROTATE_180); break;
+        case 270: cv::rotate(physical, upright, cv::ROTATE_90_CLOCKWISE); break;
+        default: physical.copyTo(upright); break;
+    }
+}
+
+const char* RenderTarget::formatName() const
+{
+    switch (format) {
+        case PixelFormat::BGRX8888: return "BGRX8888";
+        case PixelFormat::RGB565: return "RGB565";
+        default: return "BGR888";
+    }
+}
+
+int RenderTarget::normalizeRotation(int degrees)
+{
+    if (degrees % 90 != 0) return 0;
+    return ((degrees % 360) + 360) % 360;
+}
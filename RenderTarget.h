@@ -0,0 +1,38 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+// The frames the slideshow renders: the panel's scanout size, how the panel
+// is mounted and the pixel layout the presenter writes. Slides are laid out
+// upright at logicalSize() and turned into the scanout orientation by the
+// compose pass itself, so neither the window system nor the presenter has
+// to scale or rotate a frame again.
+struct RenderTarget {
+    enum class PixelFormat { BGR888, BGRX8888, RGB565 };
+
+    cv::Size size{1920, 1200};
+    // Clockwise degrees the upright picture is turned in the scanout: 0, 90, 180 or 270
+    int rotation = 0;
+    PixelFormat format = PixelFormat::BGR888;
+
+    // Upright size, width and height swapped on portrait mounted panels
+    cv::Size logicalSize() const;
+
+    // Pixel positions between upright and scanout coordinates
+    cv::Point toPhysical(cv::Point logical) const;
+    cv::Point toLogical(cv::Point physical) const;
+    cv::Rect toPhysical(const cv::Rect& logical) const;
+
+    // Puts the scanout rotation in front of a map from upright pixels to
+    // source pixels, for warps that write scanout frames directly
+    cv::Matx23d fromPhysical(const cv::Matx23d& logicalToSource) const;
+
+    // Turns a whole image, for the few frames that are not composed here
+    void rotateToPhysical(const cv::Mat& upright, cv::Mat& physical) const;
+    void rotateToLogical(const cv::Mat& physical, cv::Mat& upright) const;
+
+    const char* formatName() const;
+
+    // 0, 90, 180 or 270 for any multiple of 90, 0 otherwise
+    static int normalizeRotation(int degrees);
+};
@@ -0,0 +1,230 @@
+#include "TextRenderer.h"
+#include "ComposeKernels.h"
+#include <algorithm>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+namespace {
+    const int atlasWidth = 1024;
+
+    // Hershey fallback, scale chosen so the line height roughly matches pixelSize
+    double fallbackScale(int pixelSize) {
+        return pixelSize / 32.0;
+    }
+
+    bool preloaded(uint32_t codepoint) {
+        return (codepoint >= 0x20 && codepoint <= 0x7E) || (codepoint >= 0xA0 && codepoint <= 0xFF);
+    }
+}
+
+TextRenderer::TextRenderer(const std::string& fontPath)
+{
+    if (FT_Init_FreeType(&library) != 0) {
+        std::cerr << "FreeType could not be initialised, using the built-in font" << std::endl;
+        library = nullptr;
+        return;
+    }
+    if (FT_New_Face(library, fontPath.c_str(), 0, &face) != 0) {
+        std::cerr << "Font " << fontPath << " could not be loaded, using the built-in font" << std::endl;
+        face = nullptr;
+    }
+}
+
+TextRenderer::~TextRenderer()
+{
+    if (face) FT_Done_Face(face);
+    if (library) FT_Done_FreeType(library);
+}
+
+bool TextRenderer::isOpen() const {
+    return face != nullptr;
+}
+
+void TextRenderer::selectSize(int pixelSize)
+{
+    if (pixelSize != currentPixelSize) {
+        FT_Set_Pixel_Sizes(face, 0, static_cast<FT_UInt>(pixelSize));
+        currentPixelSize = pixelSize;
+    }
+}
+
+void TextRenderer::preload(int pixelSize)
+{
+    if (!face) return;
+    Atlas& atlas = atlasFor(pixelSize);
+    for (uint32_t codepoint = 0x20; codepoint <= 0xFF; ++codepoint) {
+        if (preloaded(codepoint)) glyphFor(atlas, pixelSize, codepoint);
+    }
+    // Dashes, quotes, ellipsis and the euro sign show up in folder names
+    const uint32_t punctuation[] = { 0x2013, 0x2014, 0x2018, 0x2019, 0x201C, 0x201D, 0x2026, 0x20AC };
+    for (uint32_t codepoint : punctuation) {
+        glyphFor(atlas, pixelSize, codepoint);
+    }
+}
+
+TextRenderer::Atlas& TextRenderer::atlasFor(int pixelSize)
+{
+    auto it = atlases.find(pixelSize);
+    if (it != atlases.end()) return it->second;
+
+    Atlas& atlas = atlases[pixelSize];
+    selectSize(pixelSize);
+    atlas.ascender = static_cast<int>(face->size->metrics.ascender >> 6);
+    atlas.descender = static_cast<int>(face->size->metrics.descender >> 6);
+    atlas.pixels = cv::Mat::zeros(std::max(64, pixelSize * 8), atlasWidth, CV_8UC1);
+    return atlas;
+}
+
+const TextRenderer::Glyph& TextRenderer::glyphFor(Atlas& atlas, int pixelSize, uint32_t codepoint)
+{
+    auto it = atlas.glyphs.find(codepoint);
+    if (it != atlas.glyphs.end()) return it->second;
+
+    Glyph& glyph = atlas.glyphs[codepoint];
+    selectSize(pixelSize);
+    glyph.index = FT_Get_Char_Index(face, codepoint);
+    if (FT_Load_Glyph(face, glyph.index, FT_LOAD_RENDER) != 0) {
+        return glyph;
+    }
+
+    const FT_GlyphSlot slot = face->glyph;
+    const FT_Bitmap& bitmap = slot->bitmap;
+    glyph.bearingX = slot->bitmap_left;
+    glyph.bearingY = slot->bitmap_top;
+    glyph.advance = static_cast<int>(slot->advance.x >> 6);
+
+    int width = static_cast<int>(bitmap.width);
+    int height = static_cast<int>(bitmap.rows);
+    if (width == 0 || height == 0 || bitmap.pixel_mode != FT_PIXEL_MODE_GRAY) {
+        return glyph;
+    }
+
+    // Shelf packing, the atlas only grows downwards so earlier rectangles stay valid
+    if (atlas.shelfX + width > atlas.pixels.cols) {
+        atlas.shelfX = 0;
+        atlas.shelfY += atlas.shelfHeight + 1;
+        atlas.shelfHeight = 0;
+    }
+    if (atlas.shelfY + height > atlas.pixels.rows) {
+        cv::Mat grown = cv::Mat::zeros(std::max(atlas.pixels.rows * 2, atlas.shelfY + height), atlas.pixels.cols, CV_8UC1);
+        atlas.pixels.copyTo(grown.rowRange(0, atlas.pixels.rows));
+        atlas.pixels = grown;
+    }
+
+    glyph.atlasRect = cv::Rect(atlas.shelfX, atlas.shelfY, width, height);
+    for (int y = 0; y < height; ++y) {
+        std::copy(bitmap.buffer + y * bitmap.pitch, bitmap.buffer + y * bitmap.pitch + width,
+                  atlas.pixels.ptr<uchar>(atlas.shelfY + y) + atlas.shelfX);
+    }
+    atlas.shelfX += width + 1;
+    atlas.shelfHeight = std::max(atlas.shelfHeight, height);
+    return glyph;
+}
+
+std::vector<uint32_t> TextRenderer::decodeUtf8(const std::string& text)
+{
+    std::vector<uint32_t> codepoints;
+    codepoints.reserve(text.size());
+    for (size_t i = 0; i < text.size();) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        int length = c < 0x80 ? 1 : (c >> 5) == 0x06 ? 2 : (c >> 4) == 0x0E ? 3 : (c >> 3) == 0x1E ? 4 : 0;
+        uint32_t codepoint = length == 1 ? c : length == 2 ? (c & 0x1F) : length == 3 ? (c & 0x0F) : (c & 0x07);
+
+        bool valid = length > 0 && i + length <= text.size();
+        for (int k = 1; valid && k < length; ++k) {
+            unsigned char next = static_cast<unsigned char>(text[i + k]);
+            valid = (next & 0xC0) == 0x80;
+            codepoint = (codepoint << 6) | (next & 0x3F);
+        }
+
+        // Invalid sequences show as the replacement character, one byte at a time
+        codepoints.push_back(valid ? codepoint : 0xFFFD);
+        i += valid ? length : 1;
+    }
+    return codepoints;
+}
+
+const TextRenderer::TextBlock& TextRenderer::layout(const std::string& text, int pixelSize)
+{
+    std::string key = std::to_string(pixelSize) + '\n' + text;
+    auto it = cache.find(key);
+    if (it != cache.end()) return it->second;
+
+    // Date and counter change with every slide, keep the cache bounded
+    if (cache.size() >= maxCachedTexts) {
+        cache.clear();
+    }
+
+    Atlas& atlas = atlasFor(pixelSize);
+    selectSize(pixelSize);
+    bool kerning = FT_HAS_KERNING(face);
+
+    struct Placed { const Glyph* glyph; int x; };
+    std::vector<Placed> placed;
+    int pen = 0;
+    int left = 0;
+    int right = 0;
+    unsigned int previous = 0;
+    for (uint32_t codepoint : decodeUtf8(text)) {
+        const Glyph& glyph = glyphFor(atlas, pixelSize, codepoint);
+        if (kerning && previous && glyph.index) {
+            FT_Vector delta;
+            FT_Get_Kerning(face, previous, glyph.index, FT_KERNING_DEFAULT, &delta);
+            pen += static_cast<int>(delta.x >> 6);
+        }
+        placed.push_back({ &glyph, pen + glyph.bearingX });
+        left = std::min(left, pen + glyph.bearingX);
+        right = std::max(right, pen + glyph.bearingX + glyph.atlasRect.width);
+        pen += glyph.advance;
+        previous = glyph.index;
+    }
+    right = std::max(right, pen);
+
+    TextBlock& block = cache[key];
+    block.baseline = atlas.ascender;
+    block.alpha = cv::Mat::zeros(std::max(1, atlas.ascender - atlas.descender), std::max(1, right - left), CV_8UC1);
+
+    for (const Placed& p : placed) {
+        const cv::Rect& source = p.glyph->atlasRect;
+        if (source.empty()) continue;
+        cv::Rect target(p.x - left, block.baseline - p.glyph->bearingY, source.width, source.height);
+        cv::Rect clipped = target & cv::Rect(0, 0, block.alpha.cols, block.alpha.rows);
+        if (clipped.empty()) continue;
+
+        // Neighbouring glyphs may overlap by a pixel, keep the stronger coverage
+        cv::Mat from = atlas.pixels(cv::Rect(source.x + clipped.x - target.x, source.y + clipped.y - target.y,
+                                             clipped.width, clipped.height));
+        cv::Mat to = block.alpha(clipped);
+        cv::max(to, from, to);
+    }
+    return block;
+}
+
+cv::Size TextRenderer::measure(const std::string& text, int pixelSize, int* baseline)
+{
+    if (!face) {
+        int below = 0;
+        cv::Size size = cv::getTextSize(text, cv::FONT_HERSHEY_SIMPLEX, fallbackScale(pixelSize), 1, &below);
+        if (baseline) *baseline = size.height;
+        return cv::Size(size.width, size.height + below);
+    }
+
+    const TextBlock& block = layout(text, pixelSize);
+    if (baseline) *baseline = block.baseline;
+    return block.alpha.size();
+}
+
+void TextRenderer::draw(cv::Mat& mat, const std::string& text, int pixelSize, cv::Point origin, const cv::Scalar& color)
+{
+    if (mat.empty() || text.empty()) return;
+
+    if (!face) {
+        int baseline = 0;
+        measure(text, pixelSize, &baseline);
+        cv::putText(mat, text, cv::Point(origin.x, origin.y + baseline), cv::FONT_HERSHEY_SIMPLEX,
+                    fallbackScale(pixelSize), color, 1, cv::LINE_AA);
+        return;
+    }
+
+    ComposeKernels::blendMask(mat, layout(text, pixelSize).alpha, origin, color);
+}
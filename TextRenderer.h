@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+
+struct FT_LibraryRec_;
+struct FT_FaceRec_;
+
+// Overlay text from a TrueType font. Glyphs are rasterized once per pixel
+// size into an atlas, strings are laid out from the atlas (UTF-8, kerning)
+// into a coverage mask that is cached per text and size, so drawing an
+// overlay that was shown before is a single alpha blit.
+// Falls back to the Hershey font when the TTF cannot be loaded.
+class TextRenderer {
+public:
+    explicit TextRenderer(const std::string& fontPath);
+    ~TextRenderer();
+
+    TextRenderer(const TextRenderer&) = delete;
+    TextRenderer& operator=(const TextRenderer&) = delete;
+
+    bool isOpen() const;
+
+    // Rasterizes the Latin-1 range and common punctuation for a pixel size
+    void preload(int pixelSize);
+
+    // Line box of the text, baseline receives the distance from its top to the baseline
+    cv::Size measure(const std::string& text, int pixelSize, int* baseline = nullptr);
+
+    // Draws the text with the top-left corner of its line box at origin, clipped to mat
+    void draw(cv::Mat& mat, const std::string& text, int pixelSize, cv::Point origin, const cv::Scalar& color);
+
+private:
+    struct Glyph {
+        cv::Rect atlasRect;
+        int bearingX = 0;
+        int bearingY = 0;
+        int advance = 0;
+        unsigned int index = 0;
+    };
+
+    struct Atlas {
+        cv::Mat pixels;
+        int shelfX = 0;
+        int shelfY = 0;
+        int shelfHeight = 0;
+        int ascender = 0;
+        int descender = 0;
+        std::unordered_map<uint32_t, Glyph> glyphs;
+    };
+
+    struct TextBlock {
+        cv::Mat alpha;
+        int baseline = 0;
+    };
+
+    Atlas& atlasFor(int pixelSize);
+    const Glyph& glyphFor(Atlas& atlas, int pixelSize, uint32_t codepoint);
+    const TextBlock& layout(const std::string& text, int pixelSize);
+    void selectSize(int pixelSize);
+    static std::vector<uint32_t> decodeUtf8(const std::string& text);
+
+    FT_LibraryRec_* library = nullptr;
+    FT_FaceRec_* face = nullptr;
+    int currentPixelSize = 0;
+
+    std::map<int, Atlas> atlases;
+    std::unordered_map<std::string, TextBlock> cache;
+    const size_t maxCachedTexts = 256;
+};
@@ -0,0 +1,242 @@
+#include "ThreadPolicy.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <sched.h>
+#include <sstream>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+    // From linux/ioprio.h, glibc has no wrapper
+    const int ioprioWhoProcess = 1;
+    const int ioprioClassShift = 13;
+    const int ioprioClassBestEffort = 2;
+    const int ioprioClassIdle = 3;
+
+    pid_t threadId() {
+        return static_cast<pid_t>(syscall(SYS_gettid));
+    }
+
+    const char* schedulingName(ThreadPolicy::Scheduling scheduling) {
+        switch (scheduling) {
+            case ThreadPolicy::Scheduling::Normal: return "normal";
+            case ThreadPolicy::Scheduling::Batch: return "batch";
+            case ThreadPolicy::Scheduling::Idle: return "idle";
+            case ThreadPolicy::Scheduling::Fifo: return "fifo";
+            default: return "inherit";
+        }
+    }
+
+    const char* ioClassName(ThreadPolicy::IoClass ioClass) {
+        switch (ioClass) {
+            case ThreadPolicy::IoClass::Default: return "default";
+            case ThreadPolicy::IoClass::BestEffort: return "besteffort";
+            case ThreadPolicy::IoClass::Idle: return "idle";
+            default: return "inherit";
+        }
+    }
+
+    bool parseInt(const std::string& value, int& number) {
+        if (value.empty() || value.size() > 4 || !std::all_of(value.begin(), value.end(), ::isdigit)) return false;
+        number = std::stoi(value);
+        return true;
+    }
+}
+
+ThreadPolicy ThreadPolicy::background()
+{
+    ThreadPolicy policy;
+    policy.scheduling = Scheduling::Idle;
+    policy.ioClass = IoClass::Idle;
+    return policy;
+}
+
+ThreadPolicy ThreadPolicy::current()
+{
+    ThreadPolicy policy;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) policy.cpus.push_back(cpu);
+        }
+    }
+
+    switch (sched_getscheduler(0)) {
+        case SCHED_BATCH: policy.scheduling = Scheduling::Batch; break;
+        case SCHED_IDLE: policy.scheduling = Scheduling::Idle; break;
+        case SCHED_FIFO:
+        case SCHED_RR: {
+            policy.scheduling = Scheduling::Fifo;
+            sched_param param{};
+            if (sched_getparam(0, &param) == 0) policy.rtPriority = param.sched_priority;
+            break;
+        }
+        default: policy.scheduling = Scheduling::Normal; break;
+    }
+    errno = 0;
+    int nice = getpriority(PRIO_PROCESS, static_cast<id_t>(threadId()));
+    if (errno == 0) policy.nice = nice;
+
+    long ioprio = syscall(SYS_ioprio_get, ioprioWhoProcess, 0);
+    int ioClass = ioprio < 0 ? 0 : static_cast<int>(ioprio >> ioprioClassShift);
+    if (ioClass == ioprioClassBestEffort) {
+        policy.ioClass = IoClass::BestEffort;
+        policy.ioLevel = static_cast<int>(ioprio & ((1 << ioprioClassShift) - 1));
+    } else if (ioClass == ioprioClassIdle) {
+        policy.ioClass = IoClass::Idle;
+    } else {
+        policy.ioClass = IoClass::Default;
+    }
+    return policy;
+}
+
+ThreadPolicy ThreadPolicy::resolvedAgainst(const ThreadPolicy& base) const
+{
+    ThreadPolicy resolved = *this;
+    if (cpus.empty()) resolved.cpus = base.cpus;
+    if (scheduling == Scheduling::Inherit) {
+        resolved.scheduling = base.scheduling;
+        resolved.nice = base.nice;
+        resolved.rtPriority = base.rtPriority;
+    }
+    if (ioClass == IoClass::Inherit) {
+        resolved.ioClass = base.ioClass;
+        resolved.ioLevel = base.ioLevel;
+    }
+    return resolved;
+}
+
+int ThreadPolicy::currentThreadId()
+{
+    return static_cast<int>(threadId());
+}
+
+bool ThreadPolicy::apply(int tid) const
+{
+    int error = 0;
+
+    if (!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+        }
+        if (sched_setaffinity(tid, sizeof(set), &set) != 0) error = errno;
+    }
+
+    if (scheduling != Scheduling::Inherit) {
+        int policy = SCHED_OTHER;
+        sched_param param{};
+        if (scheduling == Scheduling::Batch) policy = SCHED_BATCH;
+        if (scheduling == Scheduling::Idle) policy = SCHED_IDLE;
+        if (scheduling == Scheduling::Fifo) {
+            policy = SCHED_FIFO;
+            param.sched_priority = rtPriority;
+        }
+        if (sched_setscheduler(tid, policy, &param) != 0) {
+            error = errno;
+        } else if (scheduling == Scheduling::Normal || scheduling == Scheduling::Batch) {
+            if (setpriority(PRIO_PROCESS, static_cast<id_t>(tid != 0 ? tid : threadId()), nice) != 0) error = errno;
+        }
+    }
+
+    if (ioClass != IoClass::Inherit) {
+        int value = 0;
+        if (ioClass == IoClass::BestEffort) value = (ioprioClassBestEffort << ioprioClassShift) | std::min(7, std::max(0, ioLevel));
+        if (ioClass == IoClass::Idle) value = ioprioClassIdle << ioprioClassShift;
+        if (syscall(SYS_ioprio_set, ioprioWhoProcess, tid, value) != 0) error = errno;
+    }
+
+    errno = error;
+    return error == 0;
+}
+
+bool ThreadPolicy::isInherit() const
+{
+    return cpus.empty() && scheduling == Scheduling::Inherit && ioClass == IoClass::Inherit;
+}
+
+bool ThreadPolicy::operator==(const ThreadPolicy& other) const
+{
+    return cpus == other.cpus && scheduling == other.scheduling && nice == other.nice && rtPriority == other.rtPriority
+        && ioClass == other.ioClass && ioLevel == other.ioLevel;
+}
+
+std::string ThreadPolicy::describe() const
+{
+    if (isInherit()) return "inherited";
+
+    std::ostringstream text;
+    if (!cpus.empty()) {
+        // Consecutive cpus as ranges, "0-2,5"
+        text << "cpus ";
+        for (size_t i = 0; i < cpus.size(); ++i) {
+            size_t last = i;
+            while (last + 1 < cpus.size() && cpus[last + 1] == cpus[last] + 1) ++last;
+            if (i > 0) text << ",";
+            text << cpus[i];
+            if (last > i) text << "-" << cpus[last];
+            i = last;
+        }
+    }
+    if (scheduling != Scheduling::Inherit) {
+        if (text.tellp() > 0) text << ", ";
+        text << schedulingName(scheduling);
+        if (scheduling == Scheduling::Normal || scheduling == Scheduling::Batch) text << " nice " << nice;
+        if (scheduling == Scheduling::Fifo) text << " " << rtPriority;
+    }
+    if (ioClass != IoClass::Inherit) {
+        if (text.tellp() > 0) text << ", ";
+        text << "io " << ioClassName(ioClass);
+        if (ioClass == IoClass::BestEffort) text << " " << ioLevel;
+    }
+    return text.str();
+}
+
+bool ThreadPolicy::parseScheduling(const std::string& value, Scheduling& scheduling)
+{
+    for (Scheduling candidate : { Scheduling::Inherit, Scheduling::Normal, Scheduling::Batch, Scheduling::Idle, Scheduling::Fifo }) {
+        if (value == schedulingName(candidate)) {
+            scheduling = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPolicy::parseIoClass(const std::string& value, IoClass& ioClass)
+{
+    for (IoClass candidate : { IoClass::Inherit, IoClass::Default, IoClass::BestEffort, IoClass::Idle }) {
+        if (value == ioClassName(candidate)) {
+            ioClass = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPolicy::parseCpus(const std::string& value, std::vector<int>& cpus)
+{
+    std::vector<int> parsed;
+    std::stringstream list(value);
+    std::string part;
+    while (std::getline(list, part, ',')) {
+        size_t dash = part.find('-');
+        int first = 0, last = 0;
+        if (dash == std::string::npos) {
+            if (!parseInt(part, first)) return false;
+            last = first;
+        } else if (!parseInt(part.substr(0, dash), first) || !parseInt(part.substr(dash + 1), last) || last < first) {
+            return false;
+        }
+        for (int cpu = first; cpu <= last; ++cpu) parsed.push_back(cpu);
+    }
+    std::sort(parsed.begin(), parsed.end());
+    parsed.erase(std::unique(parsed.begin(), parsed.end()), parsed.end());
+    cpus = parsed;
+    return true;
+}
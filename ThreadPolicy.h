@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// CPU affinity, scheduling class and I/O priority of one thread. Fields
+// left at Inherit (or empty cpus) keep what the thread already has, so a
+// policy only changes what the configuration asks for. Linux only.
+struct ThreadPolicy {
+    enum class Scheduling { Inherit, Normal, Batch, Idle, Fifo };
+    enum class IoClass { Inherit, Default, BestEffort, Idle };
+
+    std::vector<int> cpus;
+    Scheduling scheduling = Scheduling::Inherit;
+    int nice = 0;        // Normal and Batch
+    int rtPriority = 10; // Fifo, 1 to 99
+    IoClass ioClass = IoClass::Inherit;
+    int ioLevel = 4;     // BestEffort, 0 (highest) to 7
+
+    // Idle CPU and disk time only, for work nobody waits for
+    static ThreadPolicy background();
+
+    // Everything the calling thread has right now, nothing left at Inherit
+    static ThreadPolicy current();
+
+    // Inherit fields taken from base
+    ThreadPolicy resolvedAgainst(const ThreadPolicy& base) const;
+
+    // Sets the calling thread, or the thread with kernel id tid, false
+    // (with errno) when any part was refused
+    bool apply(int tid = 0) const;
+
+    // Kernel id of the calling thread, for apply() from another one
+    static int currentThreadId();
+
+    bool isInherit() const;
+    bool operator==(const ThreadPolicy& other) const;
+    bool operator!=(const ThreadPolicy& other) const { return !(*this == other); }
+    std::string describe() const;
+
+    // Config values: "normal", "batch", "idle", "fifo" / "default",
+    // "besteffort", "idle" / cpu lists like "0-1,3"
+    static bool parseScheduling(const std::string& value, Scheduling& scheduling);
+    static bool parseIoClass(const std::string& value, IoClass& ioClass);
+    static bool parseCpus(const std::string& value, std::vector<int>& cpus);
+};
@@ -0,0 +1,442 @@
+#include "X11Presenter.h"
+#include <X11/Xatom.h>
+#include <X11/keysym.h>
+#include <poll.h>
+#include <ctime>
+#include <cstring>
+#include <iostream>
+
+namespace {
+    bool shmAttachFailed = false;
+
+    int trapShmError(Display*, XErrorEvent*) {
+        shmAttachFailed = true;
+        return 0;
+    }
+
+    double threadCpuMs() {
+        timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+    }
+
+    double elapsedMs(std::chrono::steady_clock::time_point since) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+    }
+}
+
+X11Presenter::X11Presenter()
+{
+}
+
+X11Presenter::~X11Presenter()
+{
+    if (!display) {
+        cv::destroyAllWindows();
+        return;
+    }
+    // The server may still read from a buffer
+    XSync(display, False);
+    for (Buffer& buffer : buffers) {
+        destroyBuffer(buffer);
+    }
+    if (gc) XFreeGC(display, gc);
+    if (window) XDestroyWindow(display, window);
+    XCloseDisplay(display);
+}
+
+bool X11Presenter::open(const std::string& title)
+{
+    this->title = title;
+    display = XOpenDisplay(nullptr);
+
+    int major = 0, minor = 0;
+    Bool sharedPixmaps = False;
+    bool usable = display && XShmQueryVersion(display, &major, &minor, &sharedPixmaps);
+    if (usable) {
+        // Frames are written as B, G, R, X bytes or as little endian RGB565
+        // words, the server must read them that way
+        Visual* visual = DefaultVisual(display, DefaultScreen(display));
+        int depth = DefaultDepth(display, DefaultScreen(display));
+        bool bgrx = depth >= 24 && visual->red_mask == 0xFF0000 && visual->green_mask == 0xFF00 && visual->blue_mask == 0xFF;
+        bool rgb565 = depth == 16 && visual->red_mask == 0xF800 && visual->green_mask == 0x7E0 && visual->blue_mask == 0x1F;
+        format = rgb565 ? RenderTarget::PixelFormat::RGB565 : RenderTarget::PixelFormat::BGRX8888;
+        usable = ImageByteOrder(display) == LSBFirst && (bgrx || rgb565);
+    }
+
+    if (usable) {
+        int screen = DefaultScreen(display);
+        screenSize = cv::Size(DisplayWidth(display, screen), DisplayHeight(display, screen));
+        window = XCreateSimpleWindow(display, RootWindow(display, screen), 0, 0, screenSize.width, screenSize.height,
+                                     0, BlackPixel(display, screen), BlackPixel(display, screen));
+        XStoreName(display, window, title.c_str());
+        XSelectInput(display, window, ExposureMask | KeyPressMask | ButtonPressMask | ButtonReleaseMask | PointerMotionMask);
+
+        Atom wmState = XInternAtom(display, "_NET_WM_STATE", False);
+        Atom fullscreen = XInternAtom(display, "_NET_WM_STATE_FULLSCREEN", False);
+        XChangeProperty(display, window, wmState, XA_ATOM, 32, PropModeReplace, reinterpret_cast<unsigned char*>(&fullscreen), 1);
+
+        // Invisible cursor, a touch screen does not need one
+        Pixmap pixmap = XCreatePixmap(display, window, 1, 1, 1);
+        XColor color{};
+        Cursor invisibleCursor = XCreatePixmapCursor(display, pixmap, pixmap, &color, &color, 0, 0);
+        XDefineCursor(display, window, invisibleCursor);
+        XFreePixmap(display, pixmap);
+
+        gc = XCreateGC(display, window, 0, nullptr);
+        shmCompletionEvent = XShmGetEventBase(display) + ShmCompletion;
+        usable = createBuffer(buffers[0]) && createBuffer(buffers[1]);
+    }
+
+    if (!usable) {
+        std::cerr << "MIT-SHM not available, presenting through cv::imshow" << std::endl;
+        if (display) {
+            for (Buffer& buffer : buffers) destroyBuffer(buffer);
+            if (gc) XFreeGC(display, gc);
+            if (window) XDestroyWindow(display, window);
+            XCloseDisplay(display);
+        }
+        display = nullptr;
+        window = 0;
+        gc = nullptr;
+        cv::namedWindow(title, cv::WINDOW_NORMAL);
+        cv::setWindowProperty(title, cv::WND_PROP_FULLSCREEN, cv::WINDOW_FULLSCREEN);
+        return false;
+    }
+
+    XMapRaised(display, window);
+    XSync(display, False);
+    std::cout << "Presenting through MIT-SHM " << major << "." << minor << " at "
+              << screenSize.width << "x" << screenSize.height << " " << getRenderTarget().formatName() << std::endl;
+    return true;
+}
+
+bool X11Presenter::isNative() const {
+    return display != nullptr;
+}
+
+cv::Size X11Presenter::getScreenSize() const {
+    return screenSize;
+}
+
+RenderTarget X11Presenter::getRenderTarget() const {
+    RenderTarget target;
+    target.size = screenSize;
+    target.format = display ? format : RenderTarget::PixelFormat::BGR888;
+    return target;
+}
+
+cv::Mat X11Presenter::wrap(Buffer& buffer) const
+{
+    int type = format == RenderTarget::PixelFormat::RGB565 ? CV_8UC2 : CV_8UC4;
+    return cv::Mat(screenSize, type, buffer.image->data, buffer.image->bytes_per_line);
+}
+
+void X11Presenter::convert(const cv::Mat& frame, cv::Mat& target) const
+{
+    cv::cvtColor(frame, target, format == RenderTarget::PixelFormat::RGB565 ? cv::COLOR_BGR2BGR565 : cv::COLOR_BGR2BGRA);
+}
+
+bool X11Presenter::createBuffer(Buffer& buffer)
+{
+    int screen = DefaultScreen(display);
+    buffer.image = XShmCreateImage(display, DefaultVisual(display, screen), DefaultDepth(display, screen), ZPixmap,
+                                   nullptr, &buffer.shm, screenSize.width, screenSize.height);
+    int bitsPerPixel = format == RenderTarget::PixelFormat::RGB565 ? 16 : 32;
+    if (!buffer.image || buffer.image->bits_per_pixel != bitsPerPixel) return false;
+
+    buffer.shm.shmid = shmget(IPC_PRIVATE, static_cast<size_t>(buffer.image->bytes_per_line) * buffer.image->height, IPC_CREAT | 0600);
+    if (buffer.shm.shmid < 0) return false;
+    buffer.shm.shmaddr = buffer.image->data = static_cast<char*>(shmat(buffer.shm.shmid, nullptr, 0));
+    buffer.shm.readOnly = False;
+
+    // Attaching fails on remote displays, trap the error instead of exiting
+    shmAttachFailed = buffer.shm.shmaddr == reinterpret_cast<char*>(-1);
+    if (!shmAttachFailed) {
+        XErrorHandler previous = XSetErrorHandler(trapShmError);
+        XShmAttach(display, &buffer.shm);
+        XSync(display, False);
+        XSetErrorHandler(previous);
+    }
+    // The segment goes away once both sides detached
+    shmctl(buffer.shm.shmid, IPC_RMID, nullptr);
+    if (shmAttachFailed) {
+        if (buffer.shm.shmaddr != reinterpret_cast<char*>(-1)) shmdt(buffer.shm.shmaddr);
+        buffer.shm.shmaddr = nullptr;
+        return false;
+    }
+
+    std::memset(buffer.image->data, 0, static_cast<size_t>(buffer.image->bytes_per_line) * buffer.image->height);
+    buffer.content = cv::Rect();
+    return true;
+}
+
+void X11Presenter::destroyBuffer(Buffer& buffer)
+{
+    if (!buffer.image) return;
+    if (buffer.shm.shmaddr) {
+        XShmDetach(display, &buffer.shm);
+        shmdt(buffer.shm.shmaddr);
+    }
+    // XDestroyImage must not free the shared memory
+    buffer.image->data = nullptr;
+    XDestroyImage(buffer.image);
+    buffer.image = nullptr;
+}
+
+void X11Presenter::setMouseCallback(cv::MouseCallback callback, void* userdata)
+{
+    mouseCallback = callback;
+    mouseUserdata = userdata;
+    if (!display) {
+        cv::setMouseCallback(title, callback, userdata);
+    }
+}
+
+void X11Presenter::waitForBuffer(Buffer& buffer)
+{
+    while (buffer.busy) {
+        XEvent event;
+        XNextEvent(display, &event);
+        int key = handleEvent(event);
+        if (key >= 0) pendingKeys.push_back(key);
+    }
+}
+
+void X11Presenter::present(const cv::Mat& frame)
+{
+    if (frame.empty()) return;
+
+    double cpuStart = threadCpuMs();
+    if (!display) {
+        auto start = std::chrono::steady_clock::now();
+        cv::imshow(title, frame);
+        double latency = elapsedMs(start);
+        latencyTotalMs += latency;
+        latencyMaxMs = std::max(latencyMaxMs, latency);
+        latencySamples++;
+        cpuTotalMs += threadCpuMs() - cpuStart;
+        frames++;
+        return;
+    }
+
+    Buffer& buffer = buffers[nextBuffer];
+    waitForBuffer(buffer);
+    cpuStart = threadCpuMs();
+    buffer.presentTime = std::chrono::steady_clock::now();
+
+    // Frames that do not match the screen are letterboxed like HighGUI would
+    cv::Rect content(0, 0, screenSize.width, screenSize.height);
+    if (frame.size() != screenSize) {
+        double scale = std::min(static_cast<double>(screenSize.width) / frame.cols, static_cast<double>(screenSize.height) / frame.rows);
+        cv::Size fit(std::max(1, static_cast<int>(frame.cols * scale)), std::max(1, static_cast<int>(frame.rows * scale)));
+        content = cv::Rect((screenSize.width - fit.width) / 2, (screenSize.height - fit.height) / 2, fit.width, fit.height);
+    }
+
+    cv::Mat target = wrap(buffer);
+    if (content != buffer.content) {
+        target.setTo(cv::Scalar::all(0));
+        buffer.content = content;
+    }
+
+    cv::Mat roi = target(content);
+    if (content.size() == frame.size()) {
+        convert(frame, roi);
+    } else {
+        cv::resize(frame, scaled, content.size(), 0, 0, cv::INTER_AREA);
+        convert(scaled, roi);
+    }
+
+    XShmPutImage(display, window, gc, buffer.image, 0, 0, 0, 0, screenSize.width, screenSize.height, True);
+    XFlush(display);
+    buffer.busy = true;
+    frameSize = frame.size();
+    shownBuffer = nextBuffer;
+    nextBuffer = 1 - nextBuffer;
+
+    cpuTotalMs += threadCpuMs() - cpuStart;
+    frames++;
+}
+
+bool X11Presenter::presentRegion(const cv::Mat& frame, const cv::Rect& region)
+{
+    if (!display || shownBuffer < 0 || frame.size() != screenSize || frameSize != screenSize) {
+        return false;
+    }
+    cv::Rect area = region & cv::Rect(0, 0, screenSize.width, screenSize.height);
+    if (area.empty()) return true;
+
+    // The image on screen is patched in place: its last put has completed,
+    // and the other buffer is fully rewritten by the next present anyway
+    Buffer& buffer = buffers[shownBuffer];
+    waitForBuffer(buffer);
+    double cpuStart = threadCpuMs();
+    buffer.presentTime = std::chrono::steady_clock::now();
+
+    cv::Mat patch = wrap(buffer)(area);
+    convert(frame(area), patch);
+    XShmPutImage(display, window, gc, buffer.image, area.x, area.y, area.x, area.y, area.width, area.height, True);
+    XFlush(display);
+    buffer.busy = true;
+
+    cpuTotalMs += threadCpuMs() - cpuStart;
+    regions++;
+    regionPixels += static_cast<size_t>(area.area());
+    return true;
+}
+
+cv::Point X11Presenter::toFrame(int x, int y) const
+{
+    if (shownBuffer < 0 || buffers[shownBuffer].content.empty()) return cv::Point(x, y);
+    const cv::Rect& content = buffers[shownBuffer].content;
+    return cv::Point((x - content.x) * frameSize.width / content.width,
+                     (y - content.y) * frameSize.height / content.height);
+}
+
+int X11Presenter::handleEvent(XEvent& event)
+{
+    if (event.type == shmCompletionEvent) {
+        const XShmCompletionEvent& completion = reinterpret_cast<const XShmCompletionEvent&>(event);
+        for (Buffer& buffer : buffers) {
+            if (buffer.busy && buffer.shm.shmseg == completion.shmseg) {
+                buffer.busy = false;
+                double latency = elapsedMs(buffer.presentTime);
+                latencyTotalMs += latency;
+                latencyMaxMs = std::max(latencyMaxMs, latency);
+                latencySamples++;
+            }
+        }
+        return -1;
+    }
+
+    switch (event.type) {
+        case ButtonPress:
+        case ButtonRelease: {
+            bool press = event.type == ButtonPress;
+            int button = event.xbutton.button;
+            if (mouseCallback && (button == Button1 || button == Button3)) {
+                int cvEvent = button == Button1 ? (press ? cv::EVENT_LBUTTONDOWN : cv::EVENT_LBUTTONUP)
+                                                : (press ? cv::EVENT_RBUTTONDOWN : cv::EVENT_RBUTTONUP);
+                cv::Point p = toFrame(event.xbutton.x, event.xbutton.y);
+                mouseCallback(cvEvent, p.x, p.y, 0, mouseUserdata);
+            }
+            return -1;
+        }
+        case MotionNotify:
+            if (mouseCallback) {
+                cv::Point p = toFrame(event.xmotion.x, event.xmotion.y);
+                mouseCallback(cv::EVENT_MOUSEMOVE, p.x, p.y, 0, mouseUserdata);
+            }
+            return -1;
+        case KeyPress: {
+            KeySym key = XLookupKeysym(&event.xkey, 0);
+            if (key == XK_Escape) return 27;
+            return key < 256 ? static_cast<int>(key) : -1;
+        }
+        case Expose:
+            // Put the last frame back, e.g. after the screen saver
+            if (event.xexpose.count == 0 && shownBuffer >= 0 && !buffers[shownBuffer].busy) {
+                Buffer& buffer = buffers[shownBuffer];
+                buffer.presentTime = std::chrono::steady_clock::now();
+                XShmPutImage(display, window, gc, buffer.image, 0, 0, 0, 0, screenSize.width, screenSize.height, True);
+                buffer.busy = true;
+            }
+            return -1;
+        default:
+            return -1;
+    }
+}
+
+int X11Presenter::waitKey(int delay)
+{
+    if (!display) {
+        return cv::waitKey(delay);
+    }
+
+    // Like cv::waitKey, 0 or less waits until a key is pressed
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(delay);
+    XFlush(display);
+    while (true) {
+        int key = -1;
+        dispatchPending(key);
+        if (key >= 0) return key;
+
+        int remaining = delay > 0 ? static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                        deadline - std::chrono::steady_clock::now()).count()) : -1;
+        if (delay > 0 && remaining <= 0) return -1;
+
+        pollfd descriptor{ ConnectionNumber(display), POLLIN, 0 };
+        poll(&descriptor, 1, remaining);
+    }
+}
+
+int X11Presenter::waitEvents(EventLoop& loop, std::chrono::steady_clock::time_point deadline)
+{
+    if (!display || !loop.isOpen()) {
+        int delay = 10;
+        if (deadline != std::chrono::steady_clock::time_point::max()) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            delay = static_cast<int>(std::max<std::chrono::milliseconds::rep>(1, std::min<std::chrono::milliseconds::rep>(delay, remaining.count())));
+        }
+        return waitKey(delay);
+    }
+
+    if (watchedBy != &loop && loop.watch(ConnectionNumber(display))) {
+        watchedBy = &loop;
+    }
+
+    // Events Xlib already read from the socket (while waiting for a
+    // ShmCompletion, say) do not make the fd readable again
+    XFlush(display);
+    while (true) {
+        int key = -1;
+        if (dispatchPending(key)) return key;
+        if (std::chrono::steady_clock::now() >= deadline) return -1;
+        if (loop.wait(deadline) != EventLoop::Wake::Input) return -1;
+    }
+}
+
+bool X11Presenter::dispatchPending(int& key)
+{
+    bool handled = false;
+    while (XPending(display)) {
+        XEvent event;
+        XNextEvent(display, &event);
+        int pressed = handleEvent(event);
+        if (pressed >= 0) pendingKeys.push_back(pressed);
+        handled = true;
+    }
+    if (key < 0 && !pendingKeys.empty()) {
+        key = pendingKeys.front();
+        pendingKeys.pop_front();
+        handled = true;
+    }
+    return handled;
+}
+
+size_t X11Presenter::heldBytes() const
+{
+    size_t bytes = scaled.total() * scaled.elemSize();
+    for (const Buffer& buffer : buffers) {
+        if (buffer.image != nullptr) {
+            bytes += static_cast<size_t>(buffer.image->bytes_per_line) * buffer.image->height;
+        }
+    }
+    return bytes;
+}
+
+void X11Presenter::logStats()
+{
+    if (frames == 0 && regions == 0) return;
+    std::cout << "Present (" << (display ? "XShm" : "imshow") << "): " << frames << " frames, " << regions << " partial updates ("
+              << regionPixels * (format == RenderTarget::PixelFormat::RGB565 ? 2 : 4) / 1024 << " KB), latency "
+              << (latencySamples ? latencyTotalMs / latencySamples : 0.0) << " ms avg / " << latencyMaxMs << " ms max, CPU "
+              << cpuTotalMs / std::max(1, frames + regions) << " ms per update" << std::endl;
+    frames = 0;
+    regions = 0;
+    regionPixels = 0;
+    latencyTotalMs = 0.0;
+    latencyMaxMs = 0.0;
+    latencySamples = 0;
+    cpuTotalMs = 0.0;
+}
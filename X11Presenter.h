@@ -0,0 +1,112 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <deque>
+#include <opencv2/opencv.hpp>
+#include "RenderTarget.h"
+#include "EventLoop.h"
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+// Owns the fullscreen window and presents frames through MIT-SHM: every
+// frame is converted once into a shared-memory image in the server's BGRX
+// or RGB565 layout and shown with a single XShmPutImage, no copies through
+// HighGUI.
+// Two images are used in turn, a buffer is only rewritten after the server
+// reported ShmCompletion for it. Input events are delivered to the same
+// cv::MouseCallback as HighGUI would, in frame coordinates.
+// When the display has no usable MIT-SHM, open() fails and the presenter
+// falls back to cv::imshow/cv::waitKey.
+class X11Presenter {
+public:
+    X11Presenter();
+    ~X11Presenter();
+
+    X11Presenter(const X11Presenter&) = delete;
+    X11Presenter& operator=(const X11Presenter&) = delete;
+
+    // Creates the fullscreen window, false if the HighGUI fallback is used
+    bool open(const std::string& title);
+    bool isNative() const;
+    cv::Size getScreenSize() const;
+
+    // Scanout size and pixel format frames should be rendered for, rotation is left at 0
+    RenderTarget getRenderTarget() const;
+
+    void setMouseCallback(cv::MouseCallback callback, void* userdata = nullptr);
+
+    // Shows a CV_8UC3 frame, scaled to fit when it does not match the screen
+    void present(const cv::Mat& frame);
+
+    // Updates only region of the frame on screen. False when that is not
+    // possible (HighGUI fallback, frames not matching the screen), then the
+    // whole frame has to be presented.
+    bool presentRegion(const cv::Mat& frame, const cv::Rect& region);
+
+    // Handles window events for up to delay ms (at least once), returns the key pressed or -1
+    int waitKey(int delay);
+
+    // Sleeps in loop until window events arrive, loop is notified or
+    // deadline (time_point::max() for none) has passed. Returns the key
+    // pressed or -1, and after any handled event so mouse input is acted on
+    // right away. The HighGUI fallback still polls in steps of 10 ms.
+    int waitEvents(EventLoop& loop, std::chrono::steady_clock::time_point deadline);
+
+    // Prints present latency and CPU time per frame since the last call
+    void logStats();
+
+    // Shared-memory images and the scaling buffer
+    size_t heldBytes() const;
+
+private:
+    struct Buffer {
+        XImage* image = nullptr;
+        XShmSegmentInfo shm{};
+        bool busy = false;
+        std::chrono::steady_clock::time_point presentTime;
+        cv::Rect content;
+    };
+
+    bool createBuffer(Buffer& buffer);
+    void destroyBuffer(Buffer& buffer);
+    int handleEvent(XEvent& event);
+    bool dispatchPending(int& key);
+    void waitForBuffer(Buffer& buffer);
+    cv::Point toFrame(int x, int y) const;
+    cv::Mat wrap(Buffer& buffer) const;
+    void convert(const cv::Mat& frame, cv::Mat& target) const;
+
+    std::string title;
+    Display* display = nullptr;
+    EventLoop* watchedBy = nullptr; // loop the connection fd was added to
+    Window window = 0;
+    GC gc = nullptr;
+    int shmCompletionEvent = 0;
+    cv::Size screenSize;
+    RenderTarget::PixelFormat format = RenderTarget::PixelFormat::BGRX8888;
+
+    Buffer buffers[2];
+    int nextBuffer = 0;
+    int shownBuffer = -1;
+    cv::Size frameSize;
+    cv::Mat scaled;
+
+    cv::MouseCallback mouseCallback = nullptr;
+    void* mouseUserdata = nullptr;
+    // Keys read while present() waited for a buffer, or behind another key,
+    // returned by the next waitKey()/waitEvents()
+    std::deque<int> pendingKeys;
+
+    // Since the last logStats()
+    int frames = 0;
+    double latencyTotalMs = 0.0;
+    double latencyMaxMs = 0.0;
+    int latencySamples = 0;
+    double cpuTotalMs = 0.0;
+    int regions = 0;
+    size_t regionPixels = 0;
+};
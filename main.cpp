@@ -3,6 +3,22 @@
 #include <string>
 #include <chrono>
 #include "DisplayImg.h"
+#include "Benchmark.h"
+#include "FramePool.h"
+#include "MemoryGovernor.h"
+#include "X11Presenter.h"
+#include "Crossfade.h"
+#include "KenBurns.h"
+#include "Compositor.h"
+#include "RenderTarget.h"
+#include "Executor.h"
+#include "LatencyHistogram.h"
+#include "EventLoop.h"
+#include "ThreadPolicy.h"
+#include "IoService.h"
+#include <array>
+#include <cerrno>
+#include <cstring>
 #include <opencv2/opencv.hpp>
 #include <X11/Xlib.h>
 #include <X11/cursorfont.h>
@@ -28,6 +44,7 @@ std::chrono::steady_clock::time_point clickTime;
 bool showClickEffect = false;
 
 int globalTimer = 30;
+int globalSwitchLeadMs = 2000;
 std::vector<std::string> globalFilters;
 bool globalEnableTouch = true;
 bool globalShowDate = true;
@@ -37,11 +54,50 @@ bool globalShowFolderName = true;
 bool isPressed = false;
 bool pendingClick = false;
 
+// Zoom gestures: long press toggles zoom, dragging pans while zoomed
+const int dragThreshold = 20;
+const std::chrono::milliseconds longPressDuration(700);
+bool dragging = false;
+bool longPressHandled = false;
+int lastMoveX = 0, lastMoveY = 0;
+int pendingPanX = 0, pendingPanY = 0;
+int globalZoomMemoryBudgetMB = 64;
+double globalParallelDecodeMinMegapixels = 16.0;
+std::string globalFontPath = "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf";
+int globalFramePoolMB = 256;
+int globalMemoryLimitMB = 0; // 0: half of the RAM
+int globalTransitionMs = 800;
+int globalTransitionFps = 30;
+int globalKenBurnsFps = 25;
+double globalKenBurnsZoom = 1.3;
+std::string globalKenBurnsFocus = "subject";
+int globalRotation = 0;
+int globalWorkerThreads = 0;
+bool globalLoadingIndicator = true;
+int globalPrefetchMinDepth = 2;
+int globalPrefetchMaxDepth = 8;
+int globalPrefetchMemoryMB = 128;
+int globalIoTimeoutMs = 15000;
+int globalIoFailuresToTrip = 2;
+int globalIoRetrySeconds = 15;
+// Thread policies of the UI thread and of the executor per priority class,
+// index and maintenance work only gets idle CPU and disk time
+ThreadPolicy globalUiPolicy;
+std::array<ThreadPolicy, Executor::priorityCount> globalWorkerPolicies = {
+    ThreadPolicy(), ThreadPolicy(), ThreadPolicy::background(), ThreadPolicy::background() };
+
+// Upright screen size; the panel may be mounted rotated, see renderTarget
 int screenWidth = 1920;
 int screenHeight = 1200;
+RenderTarget renderTarget;
 
 void onMouse(int event, int x, int y, int flags, void* userdata)
 {
+    // Events arrive in scanout coordinates, gestures work on the upright picture
+    cv::Point upright = renderTarget.toLogical(cv::Point(x, y));
+    x = upright.x;
+    y = upright.y;
+
     if(globalEnableTouch){
         if (event == cv::EVENT_LBUTTONDOWN || event == cv::EVENT_RBUTTONDOWN ) {
             isPressed = true;
@@ -49,13 +105,33 @@ void onMouse(int event, int x, int y, int flags, void* userdata)
             clickY = y;
             clickTime = std::chrono::steady_clock::now();
             showClickEffect = true;
+            dragging = false;
+            longPressHandled = false;
+            lastMoveX = x;
+            lastMoveY = y;
+        }
+
+        if (event == cv::EVENT_MOUSEMOVE && isPressed) {
+            if (!dragging && std::abs(x - clickX) + std::abs(y - clickY) > dragThreshold) {
+                dragging = true;
+            }
+            if (dragging) {
+                pendingPanX += x - lastMoveX;
+                pendingPanY += y - lastMoveY;
+            }
+            lastMoveX = x;
+            lastMoveY = y;
         }
 
         if(event == cv::EVENT_LBUTTONUP || event == cv::EVENT_RBUTTONUP)
         {
             if(isPressed){
                 isPressed = false;
-                pendingClick = true;
+                // Drags and long presses are gestures, not clicks
+                if (!dragging && !longPressHandled) {
+                    pendingClick = true;
+                }
+                dragging = false;
             }
         }
     }
@@ -126,6 +202,24 @@ void getOpenCVWindowHandle(const std::string& windowName) {
     XCloseDisplay(display);
 }
 
+// One entry of "threadPolicies", like {"cpus": "1-3", "scheduling": "normal", "nice": 5, "io": "idle"}
+ThreadPolicy parseThreadPolicy(const std::string& stage, const json& config) {
+    ThreadPolicy policy;
+    if (config.contains("cpus") && !ThreadPolicy::parseCpus(config["cpus"].get<std::string>(), policy.cpus)) {
+        std::cerr << "Thread policy " << stage << ": invalid cpus ignored" << std::endl;
+    }
+    if (config.contains("scheduling") && !ThreadPolicy::parseScheduling(config["scheduling"].get<std::string>(), policy.scheduling)) {
+        std::cerr << "Thread policy " << stage << ": unknown scheduling ignored" << std::endl;
+    }
+    if (config.contains("nice")) policy.nice = config["nice"];
+    if (config.contains("priority")) policy.rtPriority = config["priority"];
+    if (config.contains("io") && !ThreadPolicy::parseIoClass(config["io"].get<std::string>(), policy.ioClass)) {
+        std::cerr << "Thread policy " << stage << ": unknown io class ignored" << std::endl;
+    }
+    if (config.contains("ioLevel")) policy.ioLevel = config["ioLevel"];
+    return policy;
+}
+
 bool loadSettings(std::string configPath) {
     try {
         // Open the config file
@@ -183,6 +277,144 @@ bool loadSettings(std::string configPath) {
             globalShowFolderName = showFolderName;
         }
 
+        if (configJson.contains("zoomMemoryBudgetMB")) {
+            int zoomMemoryBudgetMB = configJson["zoomMemoryBudgetMB"];
+            std::cout << "Zoom Memory Budget: " << zoomMemoryBudgetMB << " MB" << std::endl;
+            globalZoomMemoryBudgetMB = zoomMemoryBudgetMB;
+        }
+
+        if (configJson.contains("parallelDecodeMinMegapixels")) {
+            double parallelDecodeMinMegapixels = configJson["parallelDecodeMinMegapixels"];
+            std::cout << "Parallel Decode Min Megapixels: " << parallelDecodeMinMegapixels << std::endl;
+            globalParallelDecodeMinMegapixels = parallelDecodeMinMegapixels;
+        }
+
+        if (configJson.contains("fontPath")) {
+            std::string fontPath = configJson["fontPath"];
+            std::cout << "Font: " << fontPath << std::endl;
+            globalFontPath = fontPath;
+        }
+
+        if (configJson.contains("framePoolMB")) {
+            int framePoolMB = configJson["framePoolMB"];
+            std::cout << "Frame Pool: " << framePoolMB << " MB" << std::endl;
+            globalFramePoolMB = framePoolMB;
+        }
+
+        if (configJson.contains("memoryLimitMB")) {
+            int memoryLimitMB = configJson["memoryLimitMB"];
+            std::cout << "Memory Limit: " << memoryLimitMB << " MB" << std::endl;
+            globalMemoryLimitMB = memoryLimitMB;
+        }
+
+        if (configJson.contains("transitionMs")) {
+            int transitionMs = configJson["transitionMs"];
+            std::cout << "Transition: " << transitionMs << " ms" << std::endl;
+            globalTransitionMs = transitionMs;
+        }
+
+        if (configJson.contains("transitionFps")) {
+            int transitionFps = configJson["transitionFps"];
+            std::cout << "Transition FPS: " << transitionFps << std::endl;
+            globalTransitionFps = transitionFps;
+        }
+
+        if (configJson.contains("kenBurnsFps")) {
+            int kenBurnsFps = configJson["kenBurnsFps"];
+            std::cout << "Ken Burns FPS: " << kenBurnsFps << std::endl;
+            globalKenBurnsFps = kenBurnsFps;
+        }
+
+        if (configJson.contains("kenBurnsZoom")) {
+            double kenBurnsZoom = configJson["kenBurnsZoom"];
+            std::cout << "Ken Burns Zoom: " << kenBurnsZoom << std::endl;
+            globalKenBurnsZoom = kenBurnsZoom;
+        }
+
+        if (configJson.contains("kenBurnsFocus")) {
+            std::string kenBurnsFocus = configJson["kenBurnsFocus"];
+            std::cout << "Ken Burns Focus: " << kenBurnsFocus << std::endl;
+            globalKenBurnsFocus = kenBurnsFocus;
+        }
+
+        if (configJson.contains("rotation")) {
+            int rotation = configJson["rotation"];
+            std::cout << "Rotation: " << rotation << std::endl;
+            globalRotation = rotation;
+        }
+
+        if (configJson.contains("workerThreads")) {
+            int workerThreads = configJson["workerThreads"];
+            std::cout << "Worker Threads: " << workerThreads << std::endl;
+            globalWorkerThreads = workerThreads;
+        }
+
+        if (configJson.contains("switchLeadMs")) {
+            int switchLeadMs = configJson["switchLeadMs"];
+            std::cout << "Switch Lead: " << switchLeadMs << " ms" << std::endl;
+            globalSwitchLeadMs = switchLeadMs;
+        }
+
+        if (configJson.contains("loadingIndicator")) {
+            bool loadingIndicator = configJson["loadingIndicator"];
+            std::cout << "Loading Indicator: " << loadingIndicator << std::endl;
+            globalLoadingIndicator = loadingIndicator;
+        }
+
+        if (configJson.contains("prefetchMinDepth")) {
+            int prefetchMinDepth = configJson["prefetchMinDepth"];
+            std::cout << "Prefetch Min Depth: " << prefetchMinDepth << std::endl;
+            globalPrefetchMinDepth = prefetchMinDepth;
+        }
+
+        if (configJson.contains("prefetchMaxDepth")) {
+            int prefetchMaxDepth = configJson["prefetchMaxDepth"];
+            std::cout << "Prefetch Max Depth: " << prefetchMaxDepth << std::endl;
+            globalPrefetchMaxDepth = prefetchMaxDepth;
+        }
+
+        if (configJson.contains("prefetchMemoryMB")) {
+            int prefetchMemoryMB = configJson["prefetchMemoryMB"];
+            std::cout << "Prefetch Memory MB: " << prefetchMemoryMB << std::endl;
+            globalPrefetchMemoryMB = prefetchMemoryMB;
+        }
+
+        if (configJson.contains("ioTimeoutMs")) {
+            int ioTimeoutMs = configJson["ioTimeoutMs"];
+            std::cout << "I/O Timeout ms: " << ioTimeoutMs << std::endl;
+            globalIoTimeoutMs = ioTimeoutMs;
+        }
+
+        if (configJson.contains("ioFailuresToTrip")) {
+            int ioFailuresToTrip = configJson["ioFailuresToTrip"];
+            std::cout << "I/O Failures To Trip: " << ioFailuresToTrip << std::endl;
+            globalIoFailuresToTrip = ioFailuresToTrip;
+        }
+
+        if (configJson.contains("ioRetrySeconds")) {
+            int ioRetrySeconds = configJson["ioRetrySeconds"];
+            std::cout << "I/O Retry Seconds: " << ioRetrySeconds << std::endl;
+            globalIoRetrySeconds = ioRetrySeconds;
+        }
+
+        if (configJson.contains("threadPolicies") && configJson["threadPolicies"].is_object()) {
+            const json& policies = configJson["threadPolicies"];
+            const char* stages[Executor::priorityCount] = { "interactive", "prefetch", "index", "maintenance" };
+            if (policies.contains("ui")) {
+                globalUiPolicy = parseThreadPolicy("ui", policies["ui"]);
+            }
+            for (int p = 0; p < Executor::priorityCount; ++p) {
+                if (policies.contains(stages[p])) {
+                    globalWorkerPolicies[p] = parseThreadPolicy(stages[p], policies[stages[p]]);
+                }
+            }
+            std::cout << "Thread Policies: ui " << globalUiPolicy.describe();
+            for (int p = 0; p < Executor::priorityCount; ++p) {
+                std::cout << ", " << stages[p] << " " << globalWorkerPolicies[p].describe();
+            }
+            std::cout << std::endl;
+        }
+
         return true; // Success!
     } catch (const std::exception& ex) {
         std::cerr << "Error loading settings: " << ex.what() << std::endl;
@@ -190,15 +422,72 @@ bool loadSettings(std::string configPath) {
     }
 }
 
-int main(){
+int main(int argc, char** argv){
+
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        return runBenchmarks(std::vector<std::string>(argv + 2, argv + argc));
+    }
 
     loadSettings("config.json");
-    cv::namedWindow("Window", cv::WINDOW_NORMAL);
-    cv::setWindowProperty("Window", cv::WND_PROP_FULLSCREEN, cv::WINDOW_FULLSCREEN);
 
-    cv::setMouseCallback("Window", onMouse, nullptr);
+    // Everything on the picture source goes through here, a sleeping NAS costs a deadline instead of minutes
+    IoService::instance().configure(std::chrono::milliseconds(globalIoTimeoutMs), globalIoFailuresToTrip,
+                                     std::chrono::seconds(globalIoRetrySeconds));
+
+    // Every cv::Mat from here on (decode buffers, screen frames) comes from the pool
+    FramePool::instance().setMaxPooledBytes(static_cast<size_t>(globalFramePoolMB) * 1024 * 1024);
+    cv::Mat::setDefaultAllocator(&FramePool::instance());
+    // Frames go straight to X through shared memory, HighGUI only as a fallback
+    X11Presenter presenter;
+    if (presenter.open("Window")) {
+        renderTarget = presenter.getRenderTarget();
+    } else {
+        getOpenCVWindowHandle("Window");
+        renderTarget.size = cv::Size(screenWidth, screenHeight);
+    }
+    // Frames are composed at the real screen size, pre-rotated for panels mounted in portrait
+    renderTarget.rotation = RenderTarget::normalizeRotation(globalRotation);
+    screenWidth = renderTarget.logicalSize().width;
+    screenHeight = renderTarget.logicalSize().height;
+    std::cout << "Render target: " << renderTarget.size.width << "x" << renderTarget.size.height << " "
+              << renderTarget.formatName() << ", rotated " << renderTarget.rotation << std::endl;
+    presenter.setMouseCallback(onMouse, nullptr);
+
+    // Everything on screen goes through the compositor, overlay layers only redraw their own area
+    Compositor compositor([&presenter](const cv::Mat& frame) { presenter.present(frame); },
+                          [&presenter](const cv::Mat& frame, const cv::Rect& region) { return presenter.presentRegion(frame, region); });
+
+    // Touch feedback: a small circle at the click position, white for next and blue for previous
+    cv::Point feedbackCenter;
+    cv::Scalar feedbackColor;
+    const int feedbackRadius = 10;
+    int feedbackLayer = compositor.addLayer([&](cv::Mat& region, cv::Point origin) {
+        cv::circle(region, feedbackCenter - origin, feedbackRadius, feedbackColor, 2);
+    });
+
+    // Loading indicator while a requested slide is late: a ring of dots with
+    // one lit, it looks the same on rotated panels
+    const int loadingRadius = 12;
+    const int loadingDots = 8;
+    const std::chrono::milliseconds loadingDelay(300);
+    const std::chrono::milliseconds loadingStep(125);
+    int loadingPhase = 0;
+    bool loadingShown = false;
+    std::chrono::steady_clock::time_point loadingSince;
+    std::chrono::steady_clock::time_point loadingDrawn;
+    cv::Point loadingCenter = renderTarget.toPhysical(cv::Point(screenWidth / 2, screenHeight - 40));
+    cv::Rect loadingBounds(loadingCenter.x - loadingRadius - 4, loadingCenter.y - loadingRadius - 4, 2 * loadingRadius + 9, 2 * loadingRadius + 9);
+    int loadingLayer = compositor.addLayer([&](cv::Mat& region, cv::Point origin) {
+        for (int i = 0; i < loadingDots; ++i) {
+            double angle = 2 * CV_PI * i / loadingDots;
+            cv::Point dot = loadingCenter - origin + cv::Point(cvRound(loadingRadius * std::cos(angle)), cvRound(loadingRadius * std::sin(angle)));
+            int level = i == loadingPhase ? 255 : 110;
+            cv::circle(region, dot, 2, cv::Scalar(level, level, level), cv::FILLED, cv::LINE_AA);
+        }
+    });
 
-    getOpenCVWindowHandle("Window");
+    Crossfade crossfade([&compositor](const cv::Mat& frame) { compositor.present(frame); });
+    crossfade.configure(globalTransitionMs, globalTransitionFps);
 
 
     cv::Mat image = cv::Mat::zeros(400, 800, CV_8UC3);
@@ -220,14 +509,59 @@ int main(){
 
     // Put the text on the image
     cv::putText(image, text, textOrg, fontFace, fontScale, color, thickness);
-    cv::imshow("Window", image);
-    cv::waitKey(2);
+    cv::Mat turned;
+    renderTarget.rotateToPhysical(image, turned);
+    compositor.present(turned);
+    presenter.waitKey(2);
     
+    // Background work of all kinds shares these workers, declared before
+    // display so it outlives the tasks display queues
+    Executor executor(globalWorkerThreads, globalWorkerPolicies);
+    // Only now, workers start from the policy this thread had before
+    if (!globalUiPolicy.isInherit()) {
+        if (globalUiPolicy.apply()) {
+            std::cout << "UI thread policy: " << globalUiPolicy.describe() << std::endl;
+        } else {
+            std::cerr << "UI thread policy " << globalUiPolicy.describe() << " refused (" << std::strerror(errno) << ")" << std::endl;
+        }
+    }
+    // The main loop sleeps here, display wakes it from the workers
+    EventLoop eventLoop;
+
     DisplayImg display;
     display.setFolderFilters(globalFilters);
     display.setShowDate(globalShowDate);
     display.setShowImgCount(globalShowImgCount);
     display.setShowFolderName(globalShowFolderName);
+    display.setZoomMemoryBudget(static_cast<size_t>(globalZoomMemoryBudgetMB) * 1024 * 1024);
+    display.setParallelDecodeMinMegapixels(globalParallelDecodeMinMegapixels);
+    display.setFontPath(globalFontPath);
+    display.setRenderTarget(renderTarget);
+    // Without animation no motion sources are kept
+    display.setKenBurnsZoom(globalKenBurnsFps > 0 ? globalKenBurnsZoom : 1.0);
+    display.setKenBurnsFocus(globalKenBurnsFocus);
+    display.setSwitchLead(globalSwitchLeadMs);
+    display.setPrefetchDepth(globalPrefetchMinDepth, globalPrefetchMaxDepth, static_cast<size_t>(std::max(0, globalPrefetchMemoryMB)) * 1024 * 1024);
+    display.setWakeup([&eventLoop]() { eventLoop.notify(); });
+
+    // Queue, history, zoom cache and idle pool buffers share one memory
+    // budget, idle buffers are given up first. The screen buffers count
+    // against it too but stay.
+    MemoryGovernor& memory = MemoryGovernor::instance();
+    memory.configure(static_cast<size_t>(std::max(0, globalMemoryLimitMB)) * 1024 * 1024);
+    memory.addHolder("frame pool", []() {
+        return FramePool::instance().getStats().pooledBytes;
+    }, [](size_t bytes) {
+        FramePool::instance().trim(bytes);
+    });
+    display.addMemoryHolders(memory);
+    memory.addFixed("screen", [&display, &crossfade, &compositor, &presenter]() {
+        return display.screenBytes() + crossfade.heldBytes() + compositor.heldBytes() + presenter.heldBytes();
+    });
+
+    KenBurns kenBurns([&display](double progress) { return display.renderMotion(progress); },
+                      [&compositor](const cv::Mat& frame) { compositor.present(frame); });
+    kenBurns.configure(globalKenBurnsFps);
 
     std::vector<std::string> result = display.findImages();
     if(result.empty()){
@@ -253,13 +587,15 @@ int main(){
         // Put the text on the image
         cv::putText(image, text, textOrg, fontFace, fontScale, color, thickness);
 
-        cv::imshow("Window", image);
-        cv::waitKey(2);
+        cv::Mat turned;
+        renderTarget.rotateToPhysical(image, turned);
+        compositor.present(turned);
+        presenter.waitKey(2);
 
         bool looking = true;
         while(looking){
             std::cout << "No Images found" <<std::endl;
-            cv::waitKey(5000);
+            presenter.waitKey(5000);
             result = display.findImages();
             if(!result.empty()){
                 looking = false;
@@ -270,19 +606,98 @@ int main(){
     }else{
         std::cout << result.size() << " images have benn found" <<std::endl;
     }
-    display.startPreloading();
+    display.startPreloading(executor);
 
+    // The loading screen stays up, with input still handled, until the first slide is ready
     cv::Mat img = display.getNextImage();
-    cv::imshow("Window", img);
+    while (img.empty()) {
+        if (presenter.waitEvents(eventLoop, display.preloadRetryTime()) == 27) return 0;
+        display.checkPreloadRetry();
+        if (display.isNextReady()) img = display.resumeNextImage();
+    }
+    compositor.present(img);
     
 
-    // Timer setup
-    auto lastSwitchTime = std::chrono::steady_clock::now();
-    const std::chrono::seconds switchInterval(globalTimer);  // 10 seconds
+    // Slides switch on absolute deadlines: a planned switch is the one before
+    // plus the interval, so decode and fade times do not add up over the day
+    const std::chrono::seconds switchInterval(globalTimer);
+    auto nextSwitch = std::chrono::steady_clock::now() + switchInterval;
+    display.setSwitchDeadline(nextSwitch);
+
+    // Deadline of an automatic switch whose slide is not on screen yet. A
+    // deadline passed while the user held the screen or zoomed is not jitter.
+    bool switchPlanned = false;
+    bool heldByUser = false;
+    std::chrono::steady_clock::time_point plannedSwitch;
+    LatencyHistogram switchJitter("Switch jitter");
+
+    // Pan and zoom starts once the slide is fully on screen
+    bool motionPending = true;
+
+    // Fades to a new slide, the outgoing one must be prepared in the crossfade
+    auto showSlide = [&](const cv::Mat& next) {
+        if (loadingShown) {
+            compositor.hideLayer(loadingLayer); // gone with the next present
+            loadingShown = false;
+        }
+        img = next;
+        crossfade.start(img);
+        motionPending = true;
+
+        auto shownAt = std::chrono::steady_clock::now();
+        if (switchPlanned) {
+            switchJitter.add(std::chrono::duration<double, std::milli>(shownAt - plannedSwitch).count());
+            if (switchJitter.count() % 10 == 0) switchJitter.log();
+            nextSwitch = plannedSwitch + switchInterval;
+            // Far behind after a long wait for the slide, start over from now
+            if (nextSwitch - shownAt < switchInterval / 2) nextSwitch = shownAt + switchInterval;
+        } else {
+            nextSwitch = shownAt + switchInterval;
+        }
+        switchPlanned = false;
+        heldByUser = false;
+        display.setSwitchDeadline(nextSwitch);
+
+        FramePool::instance().endSlide();
+        memory.update();
+        presenter.logStats();
+        executor.logStats();
+        eventLoop.logStats();
+        IoService::instance().logStats();
+    };
 
     while (true)
     {
-        int key = cv::waitKey(10); // Wait for 10ms
+        // Sleep until the next crossfade step, motion frame, switch (and its
+        // lead time), preparation retry, long press or loading indicator step
+        // is due. Input and
+        // slides arriving from the workers wake the loop earlier, with
+        // nothing due it sleeps until then.
+        auto waitStart = std::chrono::steady_clock::now();
+        auto due = std::chrono::steady_clock::time_point::max();
+        auto dueIn = [&](int ms) { due = std::min(due, waitStart + std::chrono::milliseconds(std::max(1, ms))); };
+        if (crossfade.isActive()) dueIn(crossfade.msUntilNextStep());
+        if (kenBurns.isActive()) dueIn(kenBurns.msUntilNextFrame());
+        if (nextSwitch > waitStart) due = std::min(due, nextSwitch);
+        due = std::min(due, std::max(waitStart, display.preloadRetryTime()));
+        auto switchLeadTime = nextSwitch - std::chrono::milliseconds(globalSwitchLeadMs);
+        if (switchLeadTime > waitStart) due = std::min(due, switchLeadTime);
+        if (isPressed && !dragging && !longPressHandled) due = std::min(due, clickTime + longPressDuration);
+        if (globalLoadingIndicator && display.isWaitingForNext()) due = std::min(due, std::max(loadingSince + loadingDelay, loadingDrawn + loadingStep));
+        // Left over from the last pass or input handled during the touch feedback
+        if ((motionPending && !crossfade.isActive()) || pendingClick || (loadingShown && !display.isWaitingForNext())) due = waitStart;
+        int key = presenter.waitEvents(eventLoop, due);
+        crossfade.tick();
+
+        if (motionPending && !crossfade.isActive())
+        {
+            motionPending = false;
+            if (!display.isZoomed()) {
+                auto remaining = nextSwitch - std::chrono::steady_clock::now();
+                kenBurns.start(std::chrono::duration_cast<std::chrono::milliseconds>(remaining));
+            }
+        }
+        kenBurns.tick();
 
         if (key == 27) // ESC key ASCII code
         {
@@ -291,14 +706,118 @@ int main(){
         }
 
         auto now = std::chrono::steady_clock::now();
-        bool timeElapsed = (now - lastSwitchTime) >= switchInterval;
 
-        bool freezeTimer = isPressed; // freeze if mouse/touch is held
+        // A slide that was not ready when it was asked for has arrived
+        if (display.isWaitingForNext() && display.isNextReady())
+        {
+            kenBurns.stop();
+            motionPending = false;
+            crossfade.prepare(img);
+            cv::Mat next = display.resumeNextImage();
+            if (!next.empty()) {
+                showSlide(next);
+            }
+        }
+
+        // Loading indicator once the wait gets noticeable
+        bool loadingWanted = globalLoadingIndicator && display.isWaitingForNext() && now - loadingSince >= loadingDelay;
+        if (loadingWanted && now - loadingDrawn >= loadingStep)
+        {
+            loadingPhase = (loadingPhase + 1) % loadingDots;
+            compositor.showLayer(loadingLayer, loadingBounds);
+            compositor.flush();
+            loadingShown = true;
+            loadingDrawn = now;
+        }
+        else if (!loadingWanted && loadingShown)
+        {
+            compositor.hideLayer(loadingLayer);
+            compositor.flush();
+            loadingShown = false;
+        }
+
+        // Long press toggles zoom on the current image
+        if (isPressed && !dragging && !longPressHandled && now - clickTime >= longPressDuration)
+        {
+            longPressHandled = true;
+            cv::Mat zoomed = display.isZoomed() ? display.resetZoom() : display.zoomAt(clickX, clickY, 2.0);
+            if (!zoomed.empty())
+            {
+                crossfade.cancel();
+                kenBurns.stop();
+                motionPending = false;
+                img = zoomed;
+                compositor.present(img);
+            }
+        }
+
+        // Dragging pans the zoomed image
+        if (display.isZoomed() && (pendingPanX != 0 || pendingPanY != 0))
+        {
+            cv::Mat panned = display.panZoom(pendingPanX, pendingPanY);
+            pendingPanX = 0;
+            pendingPanY = 0;
+            if (!panned.empty())
+            {
+                img = panned;
+                compositor.present(img);
+            }
+        }
+        else if (!display.isZoomed())
+        {
+            pendingPanX = 0;
+            pendingPanY = 0;
+        }
+
+        // While zoomed a tap zooms in (right side) or out (left side) instead of switching images
+        if (pendingClick && display.isZoomed())
+        {
+            pendingClick = false;
+            cv::Mat zoomed = display.zoomAt(clickX, clickY, clickX >= screenWidth / 2 ? 2.0 : 0.5);
+            if (!zoomed.empty())
+            {
+                img = zoomed;
+                compositor.present(img);
+            }
+            nextSwitch = now + switchInterval;
+            display.setSwitchDeadline(nextSwitch);
+        }
+
+        // Escalates the preparation when the switch is near and nothing is ready
+        display.checkSwitchDeadline();
+        // Restarts a preparation that had nothing to do
+        display.checkPreloadRetry();
+
+        bool timeElapsed = now >= nextSwitch;
+        if (timeElapsed && (isPressed || display.isZoomed())) heldByUser = true;
+
+        bool freezeTimer = isPressed || display.isZoomed() || display.isWaitingForNext(); // freeze if mouse/touch is held, zoomed in or a slide is on its way
         bool triggerChange = pendingClick || (timeElapsed && !freezeTimer);
 
+        // Swap in the full decode once a preview shown on a tap is ready
+        cv::Mat refined;
+        if (!triggerChange && !display.isZoomed() && display.refineCurrentImage(refined))
+        {
+            // A running crossfade already blends towards this buffer
+            img = refined;
+            if (!crossfade.isActive()) {
+                compositor.present(img);
+            }
+            motionPending = true;
+        }
+
         if (triggerChange)
         {
             bool rightSide = true;
+            bool userInitiated = pendingClick;
+
+            // Jitter is measured against the deadline of automatic switches only
+            plannedSwitch = nextSwitch;
+            switchPlanned = !userInitiated && !heldByUser;
+
+            // The current motion frame stays on screen for the feedback and the fade
+            kenBurns.stop();
+            motionPending = false;
 
             if (pendingClick) {
                 std::cout << "Mouse or touch clicked!" << std::endl;
@@ -310,39 +829,47 @@ int main(){
                     rightSide = false;
                 }
                 pendingClick = false;
-                // Visual feedback: draw a small circle at click position
-                cv::Mat feedback = img.clone();
-                if(rightSide){
-                    cv::circle(feedback, cv::Point(clickX, clickY), 10, cv::Scalar(255, 255, 255,0.5), 2); 
-                }else{
-                    cv::circle(feedback, cv::Point(clickX, clickY), 10, cv::Scalar(255, 0, 0,0.5), 2); 
-                }
-
-                cv::imshow("Window", feedback);
-                cv::waitKey(100); // Show for 100ms
+                // Visual feedback: draw a small circle at click position, only its square is redrawn
+                feedbackCenter = renderTarget.toPhysical(cv::Point(clickX, clickY));
+                feedbackColor = rightSide ? cv::Scalar(255, 255, 255) : cv::Scalar(255, 0, 0);
+                int extent = feedbackRadius + 3;
+                compositor.showLayer(feedbackLayer, cv::Rect(feedbackCenter.x - extent, feedbackCenter.y - extent, 2 * extent + 1, 2 * extent + 1));
+                compositor.flush();
+                presenter.waitKey(100); // Show for 100ms
+
+                // Taken off the old slide before the next one replaces the base frame
+                compositor.hideLayer(feedbackLayer);
+                compositor.flush();
 
             } else {
                 std::cout << "Auto-switch after 10 seconds!" << std::endl;
             }
 
+            // The next slide is rendered into the same buffer, keep what is on screen for the fade
+            cv::Mat next;
             if(rightSide){
-                std::cout << "getNextImage Executed" << std::endl;
-                img = display.getNextImage();
+                if (display.isWaitingForNext()) {
+                    std::cout << "getNextImage still waiting" << std::endl;
+                } else {
+                    std::cout << "getNextImage Executed" << std::endl;
+                    crossfade.prepare(img);
+                    next = display.getNextImage(userInitiated);
+                    loadingSince = std::chrono::steady_clock::now();
+                }
             }else{
                 std::cout << "getPrevImage Executed" << std::endl;
-                img = display.getPrevImage();
+                crossfade.prepare(img);
+                next = display.getPrevImage();
+                loadingSince = std::chrono::steady_clock::now();
             }
 
-            if (!img.empty())
+            // Without a slide the current one stays up, the loop switches once it arrives
+            if (!next.empty())
             {
-                cv::imshow("Window", img);
-                
-                lastSwitchTime = std::chrono::steady_clock::now(); // Reset timer
+                showSlide(next);
             }
         }
     }
 
-    cv::destroyAllWindows();
-
     return 0;
 }
\ No newline at end of file